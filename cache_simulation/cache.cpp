@@ -1,16 +1,116 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <vector>
+
 #include "cache.hpp"
+#include "cache_events.hpp"
 
 // Use this space for declaring any global variables that you might need
 
 int64_t c, s, C, S, b, v, k;
 int64_t L1_ways, L1_sets, L2_ways, L2_sets;
 int64_t L1_tag, L1_index, vic_tag, L2_tag, L2_index;
+int64_t L1_tag_mask, vic_tag_mask, L2_tag_mask; // computed once in cache_init
+uint8_t dram_on; // L2 misses and write backs go to the DRAM model
+
+// Sectored caches: a line keeps one tag but fills and writes back sectors
+bool sectors_on;
+int64_t L1_sectors, L2_sectors, L1_sector_bits;   // sectors per block, 1 when not sectored
+int64_t L1_sector_bit, L2_sector_mask;            // sectors needed by the current access
+int64_t L1_partial, L2_partial;                   // way holding the tag but not the sectors
+int64_t vic_merge_sectors, vic_merge_dirty;       // partial VC copy folded into the L1 fill
+
+// Set index functions other than the plain bit slice. Hashed levels store the
+// whole block number as the tag. Skewed levels gather the candidate line of
+// every way into a scratch set (the one past the last set) so the rest of the
+// code sees an ordinary set, and keep LRU timestamps instead of counters.
+bool hashing_on;
+int64_t L1_index_fn, L2_index_fn;                 // index_fn_t
+int64_t L1_prime, L2_prime;                       // sets used by prime-modulo indexing
+int64_t skew_clock;                               // accesses so far
+int64_t L1_gathered, L2_gathered;                 // block held in the scratch set, -1 if none
+
+// Compressed L2: twice the tags of an uncompressed set, but only as many
+// bytes of data, so a set holds a variable number of blocks
+bool compress_on;
+int64_t L2_compress;                              // compress_t
+int64_t L2_data_bytes;                            // data capacity of one set
+
+// Dead-block prediction for the L2. The predictor is trained on a sampler, a
+// shadow LRU tag store over every 2^DEAD_SAMPLE_SHIFT-th set that allocates
+// every demand fill, so bypassed blocks still teach it about their reuse.
+// Blocks are grouped into regions of 2^DEAD_REGION_BITS blocks; the
+// signature predictor also folds in the hits a line has had, a stand-in for
+// the instruction trace the traces don't record.
+static const int64_t DEAD_TABLE_BITS = 14;
+static const int64_t DEAD_REGION_BITS = 6;
+static const int64_t DEAD_SAMPLE_SHIFT = 5;
+static const int64_t DEAD_MAX_HITS = 3;                 // hits folded into a signature
+static const int64_t DEAD_COUNTER_MAX = 3;              // 2-bit saturating counters
+static const int64_t DEAD_THRESHOLD = 2;
+
+bool dead_on;
+int64_t dead_predictor;                           // dead_pred_t
+int64_t* dead_table;                              // counters, or the hits of the last generation
+int64_t* dead_conf;                               // the last two generations agreed (refcount)
+int64_t dead_sampler_sets, dead_sampler_ways;
+int64_t dead_clock;                               // sampled lookups so far
+
+// Per-set conflict profile. A skewed level charges accesses and misses to
+// the set of way 0 and evictions to the set the victim way maps to.
+bool profile_on;
+
+// Jouppi-style side structures probed with the VC on an L1 miss. The miss
+// cache keeps a copy of every block filled from the L2; a stream buffer is a
+// FIFO of the blocks following a miss, and only its head is looked up. Both
+// hold clean block numbers and use LRU timestamps from side_clock.
+bool side_on;
+int64_t mc_entries, sb_count, sb_depth;
+int64_t side_clock;                               // L1 misses so far
+
+// Header of an L1-filtered trace, after the magic: the L1/VC configuration
+// and the statistics the L2 has no effect on
+enum filter_field_t {
+		FH_VERSION, FH_C, FH_S, FH_B, FH_V, FH_L1_INDEX, FH_RECORDS,
+		FH_ACCESSES, FH_READS, FH_WRITES, FH_MISSES_L1, FH_MISSES_READS_L1, FH_MISSES_WRITES_L1,
+		FH_HITS_VC, FH_MISSES_VC, FH_MISSES_READS_VC, FH_MISSES_WRITES_VC,
+		FILTER_HEADER_FIELDS
+};
+
+// Every record is a flags byte, the number of accesses since the previous
+// record, the address, and for a line leaving L1+VC its block number and how
+// many records back it was filled. Counts are LEB128 varints, the address is
+// 8 bytes in host byte order.
+enum filter_flag_t {
+		FR_WRITE = 1,        // the access is a write
+		FR_LEAVE = 2,        // a line left L1+VC
+		FR_LEAVE_DIRTY = 4   // and was written while it was there
+};
+
+static const char FILTER_MAGIC[8] = {'C', 'S', 'I', 'M', 'F', 'L', 'T', '\0'};
+static const uint64_t FILTER_VERSION = 1;
+
+// L1-filtered traces. The filter pass runs L1 and the VC with the L2 taken out
+// and records every L2 lookup and every line that leaves L1+VC. A line filled
+// by a read inherits the dirty bit of its L2 copy, which only the replay
+// knows, so lines remember the lookup that filled them and clean lines are
+// recorded as they leave too.
+FILE *filter_out;
+int64_t filter_records;                           // lookups written so far, the id of the next fill
+int64_t filter_last;                              // access number of the previous lookup
+bool filter_lookup;                               // the current access looked up the L2
+int64_t filter_leave_block, filter_leave_dirty, filter_leave_fill; // block -1 if nothing left
+uint64_t filter_header[FILTER_HEADER_FIELDS];     // header of the trace being replayed
 
 typedef struct L1_set {
 		int64_t* counter;
 		int64_t* tag;
 		int64_t* valid;
 		int64_t* dirty;
+		int64_t* sectors;      // per-sector valid bits
+		int64_t* sector_dirty; // per-sector dirty bits
+		int64_t* fill;         // lookup that filled the line (filter pass)
 } L1_set;
 
 typedef struct L1_cache {
@@ -25,6 +125,11 @@ typedef struct L2_set {
 		int64_t* valid;
 		int64_t* dirty;
 		int64_t* prefetch;
+		int64_t* sectors;
+		int64_t* sector_dirty;
+		int64_t* size;         // compressed size in bytes
+		int64_t* refs;         // hits since the fill
+		int64_t* dead;         // predicted dead
 } L2_set;
 
 typedef struct L2_cache {
@@ -38,19 +143,187 @@ typedef struct victim {
 		int64_t* tag;
 		int64_t* valid;
 		int64_t* dirty;
+		int64_t* sectors;
+		int64_t* sector_dirty;
+		int64_t* fill;
 } victim;
 
 victim vic;
 
-void install_to_L1(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats_t *stats);
-void evict_to_vic(int64_t isDirty, int64_t tag, struct cache_stats_t *stats);
-void install_to_L2(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats_t *stats);
-void evict_to_L2(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats_t *stats);
-int64_t L1_hit();
-int64_t vic_hit();
-int64_t L2_hit(struct cache_stats_t *stats);
-void prefetch(int64_t tag, int64_t index, struct cache_stats_t *stats);
-void install_to_L1_no(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats_t *stats);
+typedef struct miss_cache {
+		int64_t* counter;      // time of the last fill or hit
+		int64_t* tag;          // block number
+		int64_t* valid;
+} miss_cache;
+
+miss_cache mc;
+
+typedef struct dead_sampler {
+		int64_t* counter;      // time of the last lookup
+		int64_t* tag;          // block number
+		int64_t* valid;
+		int64_t* refs;
+		int64_t* sig;          // signature at the last lookup
+		int64_t* pred;         // predicted dead at the last lookup
+} dead_sampler;
+
+dead_sampler* sampler;
+
+typedef struct set_profile {
+		uint64_t* accesses;
+		uint64_t* misses;
+		uint64_t* evictions;
+		uint64_t* dirty_evictions;
+} set_profile;
+
+set_profile L1_prof, L2_prof;
+
+typedef struct stream_buffer {
+		int64_t* tag;          // block number of every entry, a ring starting at head
+		int64_t* valid;
+		int64_t head;
+		int64_t next;          // block fetched into the entry that frees up next
+		int64_t counter;       // time of the last allocation or hit
+} stream_buffer;
+
+stream_buffer* sb;
+
+// Geometry policies for the access kernels. generic_geometry reads the
+// runtime configuration, fixed_geometry bakes it in at compile time so the
+// way loops unroll and the shifts and index masks fold to constants.
+struct generic_geometry {
+		static int64_t l1_ways() { return L1_ways; }
+		static int64_t l2_ways() { return L2_ways; }
+		static int64_t block_bits() { return b; }
+		static int64_t l1_set_bits() { return c - s - b; }
+		static int64_t l2_set_bits() { return C - S - b; }
+		static int64_t block_size() { return 1 << b; }
+		static int64_t l1_tag_shift() { return c - s; }
+		static int64_t l2_tag_shift() { return C - S; }
+		static int64_t l1_set_mask() { return (1 << (c - b - s)) - 1; }
+		static int64_t l2_set_mask() { return (1 << (C - S - b)) - 1; }
+		static bool sectored() { return sectors_on; }
+		static bool hashed() { return hashing_on; }
+		static bool compressed() { return compress_on; }
+		static bool side_buffers() { return side_on; }
+		static bool dead_blocks() { return dead_on; }
+		static bool profiled() { return profile_on; }
+		static bool filtering() { return false; }
+};
+
+// L1 and VC only, for writing L1-filtered traces
+struct filter_geometry : generic_geometry {
+		static bool filtering() { return true; }
+};
+
+template <int64_t SS, int64_t SB, int64_t SS2, int64_t SB2, int64_t BB>
+struct fixed_geometry { // SS/SS2: log2 ways, SB/SB2: set bits, BB: block bits
+		static int64_t l1_ways() { return int64_t(1) << SS; }
+		static int64_t l2_ways() { return int64_t(1) << SS2; }
+		static int64_t block_bits() { return BB; }
+		static int64_t l1_set_bits() { return SB; }
+		static int64_t l2_set_bits() { return SB2; }
+		static int64_t block_size() { return int64_t(1) << BB; }
+		static int64_t l1_tag_shift() { return SB + BB; }
+		static int64_t l2_tag_shift() { return SB2 + BB; }
+		static int64_t l1_set_mask() { return (int64_t(1) << SB) - 1; }
+		static int64_t l2_set_mask() { return (int64_t(1) << SB2) - 1; }
+		static bool sectored() { return false; }
+		static bool hashed() { return false; }
+		static bool compressed() { return false; }
+		static bool side_buffers() { return false; }
+		static bool dead_blocks() { return false; }
+		static bool profiled() { return false; }
+		static bool filtering() { return false; }
+};
+
+template <class G> void install_to_L1(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats_t *stats);
+template <class G> void evict_to_vic(int64_t isDirty, int64_t tag, int64_t sectors, int64_t sector_dirty, int64_t fill, struct cache_stats_t *stats);
+template <class G> void install_to_L2(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats_t *stats);
+template <class G> void evict_to_L2(int64_t isDirty, int64_t tag, int64_t index, int64_t sector_dirty, struct cache_stats_t *stats);
+template <class G> int64_t L1_hit();
+template <class G> int64_t vic_hit();
+template <class G> int64_t L2_hit(struct cache_stats_t *stats);
+template <class G> void prefetch(int64_t tag, int64_t index, struct cache_stats_t *stats);
+template <class G> void install_to_L1_no(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats_t *stats);
+template <class G> void access_kernel(uint64_t addr, char rw, struct cache_stats_t *stats);
+template <class G> void mem_request(int64_t tag, int64_t index, dram_req_t type, struct cache_stats_t *stats);
+template <class G> int64_t L1_mru(int64_t index, int64_t min);
+template <class G> int64_t L2_mru(int64_t index, int64_t min);
+template <class G> void fill_L1_sectors(int64_t isDirty, int64_t index, int64_t way, bool partial);
+template <class G> uint64_t fill_units();
+template <class G> uint64_t write_back_units(int64_t index, int64_t way);
+int64_t L1_to_L2_sectors(int64_t mask);
+int64_t largest_prime(int64_t n);
+int64_t skew_hash(int64_t block, int64_t set_bits, int64_t way);
+int64_t hashed_index(int64_t block, int64_t fn, int64_t set_bits, int64_t prime);
+int64_t L1_set_of(int64_t block);
+int64_t L2_set_of(int64_t block);
+void skew_release();
+void filter_leave(int64_t block, int64_t dirty, int64_t fill);
+template <class G> int64_t L1_block(int64_t tag, int64_t index);
+template <class G> void L2_split(int64_t block, int64_t *tag, int64_t *index);
+template <class G> int64_t L2_block(int64_t tag, int64_t index);
+template <class G> void compress_fit(int64_t index, int64_t way, struct cache_stats_t *stats);
+template <class G> bool side_hit(char rw, struct cache_stats_t *stats);
+template <class G> void side_miss(struct cache_stats_t *stats);
+template <class G> void stream_fetch(stream_buffer &buf, int64_t slot, struct cache_stats_t *stats);
+void side_invalidate(int64_t block);
+int64_t dead_sig(int64_t block, int64_t refs);
+bool dead_predict(int64_t block, int64_t refs);
+void dead_sample(int64_t block, struct cache_stats_t *stats);
+template <class G> void dead_fill(int64_t index, int64_t way);
+template <class G> int64_t dead_victim(int64_t index, int64_t lru, struct cache_stats_t *stats);
+int64_t L1_profile_set(int64_t index, int64_t way);
+int64_t L2_profile_set(int64_t index, int64_t way);
+template <class G> void profile_L1_evict(int64_t index, int64_t way);
+template <class G> void profile_L2_evict(int64_t index, int64_t way);
+template <class G> void event_L1_evict(int64_t index, int64_t way);
+template <class G> void event_L2_evict(int64_t index, int64_t way);
+int64_t count_sectors(int64_t mask);
+
+typedef void (*access_fn)(uint64_t addr, char rw, struct cache_stats_t *stats);
+
+// Specialized kernels for the geometries we run most often; anything else
+// goes through the generic kernel.
+struct kernel_entry {
+		int64_t c, s, C, S, b;
+		access_fn fn;
+};
+
+static const kernel_entry kernels[] = {
+		{15, 4, 18, 3, 6, access_kernel<fixed_geometry<4, 5, 3, 9, 6> >}, // defaults
+		{15, 3, 18, 4, 6, access_kernel<fixed_geometry<3, 6, 4, 8, 6> >}, // 8-way L1, 16-way L2
+		{15, 3, 20, 4, 6, access_kernel<fixed_geometry<3, 6, 4, 10, 6> >},
+		{14, 2, 17, 3, 6, access_kernel<fixed_geometry<2, 6, 3, 8, 6> >},
+};
+
+access_fn access_dispatch = access_kernel<generic_geometry>;
+access_fn outcome_kernel;   // the kernel outcome_access wraps
+
+// Skewed levels need their scratch sets written back after every access
+void hashed_access(uint64_t addr, char rw, struct cache_stats_t *stats)
+{
+  skew_clock++;
+  access_kernel<generic_geometry>(addr, rw, stats);
+  skew_release();
+}
+
+static access_fn select_kernel()
+{
+  if (hashing_on) {
+      return hashed_access;
+  }
+  if (sectors_on || compress_on || side_on || dead_on || profile_on) {
+      return access_kernel<generic_geometry>;
+  }
+  for (const kernel_entry &e : kernels) {
+      if (e.c == c && e.s == s && e.C == C && e.S == S && e.b == b) {
+          return e.fn;
+      }
+  }
+  return access_kernel<generic_geometry>;
+}
 
 
 
@@ -74,37 +347,106 @@ void cache_init(struct cache_config_t *conf)
   L2_ways = 1 << S;
   L2_sets = 1 << (C - S - b);
 
-  L1.sets = new L1_set[L1_sets];
+  L1_tag_mask = (1 << (64 - c + s)) - 1;
+  vic_tag_mask = (1 << (64 - b)) - 1;
+  L2_tag_mask = (1 << (64 - C + S)) - 1;
+
+  L1_sectors = int64_t(conf->l1_sectors);
+  L2_sectors = int64_t(conf->l2_sectors);
+  L1_sector_bits = 0;
+  while ((int64_t(1) << L1_sector_bits) < L1_sectors) {
+      L1_sector_bits++;
+  }
+  sectors_on = L1_sectors > 1 || L2_sectors > 1;
+  L1_partial = -1;
+  L2_partial = -1;
+
+  L1_index_fn = int64_t(conf->l1_index_fn);
+  L2_index_fn = int64_t(conf->l2_index_fn);
+  hashing_on = L1_index_fn != INDEX_BITS || L2_index_fn != INDEX_BITS;
+  L1_prime = largest_prime(L1_sets);
+  L2_prime = largest_prime(L2_sets);
+  skew_clock = 0;
+  L1_gathered = -1;
+  L2_gathered = -1;
+
+  L2_compress = int64_t(conf->l2_compress);
+  compress_on = L2_compress != COMPRESS_NONE;
+  L2_data_bytes = L2_ways << b;
+  if (compress_on) {
+      L2_ways *= 2;
+  }
+
+  dead_predictor = int64_t(conf->l2_dead_block);
+  dead_on = dead_predictor != DEAD_NONE;
+  dead_sampler_sets = L2_sets >> DEAD_SAMPLE_SHIFT > 0 ? L2_sets >> DEAD_SAMPLE_SHIFT : 1;
+  dead_sampler_ways = int64_t(1) << S;
+  dead_clock = 0;
+
+  profile_on = conf->set_profile > 0;
+
+  mc_entries = int64_t(conf->miss_cache);
+  sb_count = int64_t(conf->stream_buffers);
+  sb_depth = int64_t(conf->stream_depth);
+  side_on = mc_entries > 0 || sb_count > 0;
+  side_clock = 0;
+
+  access_dispatch = select_kernel();
+
+  dram_on = conf->dram.enabled;
+  if (dram_on) {
+      dram_init(&conf->dram, conf->b);
+  }
+
+  int64_t L1_scratch = L1_index_fn == INDEX_SKEW ? 1 : 0;
+  L1.sets = new L1_set[L1_sets + L1_scratch];
 
-  for (int64_t i = 0; i < L1_sets; i++) {
+  for (int64_t i = 0; i < L1_sets + L1_scratch; i++) {
       (L1.sets)[i].counter = new int64_t[L1_ways];
       (L1.sets)[i].tag = new int64_t[L1_ways];
       (L1.sets)[i].valid = new int64_t[L1_ways];
       (L1.sets)[i].dirty = new int64_t[L1_ways];
+      (L1.sets)[i].sectors = new int64_t[L1_ways];
+      (L1.sets)[i].sector_dirty = new int64_t[L1_ways];
+      (L1.sets)[i].fill = new int64_t[L1_ways];
 
       for (int64_t j = 0; j < L1_ways; j++) {
           (L1.sets)[i].counter[j] = 0;
           (L1.sets)[i].tag[j] = 0;
           (L1.sets)[i].valid[j] = 0;
           (L1.sets)[i].dirty[j] = 0;
+          (L1.sets)[i].sectors[j] = 0;
+          (L1.sets)[i].sector_dirty[j] = 0;
+          (L1.sets)[i].fill[j] = 0;
       }
   }
 
-  L2.sets = new L2_set[L2_sets];
+  int64_t L2_scratch = L2_index_fn == INDEX_SKEW ? 1 : 0;
+  L2.sets = new L2_set[L2_sets + L2_scratch];
 
-  for (int64_t i = 0; i < L2_sets; i++) {
+  for (int64_t i = 0; i < L2_sets + L2_scratch; i++) {
       (L2.sets)[i].counter = new int64_t[L2_ways];
       (L2.sets)[i].tag = new int64_t[L2_ways];
       (L2.sets)[i].valid = new int64_t[L2_ways];
       (L2.sets)[i].dirty = new int64_t[L2_ways];
+      (L2.sets)[i].sectors = new int64_t[L2_ways];
+      (L2.sets)[i].sector_dirty = new int64_t[L2_ways];
       (L2.sets)[i].prefetch = new int64_t[L2_ways];
+      (L2.sets)[i].size = new int64_t[L2_ways];
+      (L2.sets)[i].refs = new int64_t[L2_ways];
+      (L2.sets)[i].dead = new int64_t[L2_ways];
 
       for (int64_t j = 0; j < L2_ways; j++) {
           (L2.sets)[i].counter[j] = 0;
           (L2.sets)[i].tag[j] = 0;
           (L2.sets)[i].valid[j] = 0;
           (L2.sets)[i].dirty[j] = 0;
+          (L2.sets)[i].sectors[j] = 0;
+          (L2.sets)[i].sector_dirty[j] = 0;
           (L2.sets)[i].prefetch[j] = 0;
+          (L2.sets)[i].size[j] = 0;
+          (L2.sets)[i].refs[j] = 0;
+          (L2.sets)[i].dead[j] = 0;
       }
   }
 
@@ -112,23 +454,93 @@ void cache_init(struct cache_config_t *conf)
   vic.tag = new int64_t[v];
   vic.valid = new int64_t[v];
   vic.dirty = new int64_t[v];
+  vic.sectors = new int64_t[v];
+  vic.sector_dirty = new int64_t[v];
+  vic.fill = new int64_t[v];
 
   for (int64_t i = 0; i < v; i++) {
       vic.tag[i] = 0;
       vic.valid[i] = 0;
       vic.dirty[i] = 0;
       vic.counter[i] = 0;
+      vic.sectors[i] = 0;
+      vic.sector_dirty[i] = 0;
+      vic.fill[i] = 0;
+  }
+
+  mc.counter = new int64_t[mc_entries];
+  mc.tag = new int64_t[mc_entries];
+  mc.valid = new int64_t[mc_entries];
+
+  for (int64_t i = 0; i < mc_entries; i++) {
+      mc.counter[i] = 0;
+      mc.tag[i] = 0;
+      mc.valid[i] = 0;
+  }
+
+  int64_t dead_entries = dead_on ? int64_t(1) << DEAD_TABLE_BITS : 0;
+  dead_table = new int64_t[dead_entries];
+  dead_conf = new int64_t[dead_entries];
+
+  for (int64_t i = 0; i < dead_entries; i++) {
+      dead_table[i] = 0;
+      dead_conf[i] = 0;
+  }
+
+  int64_t sampled = dead_on ? dead_sampler_sets : 0;
+  sampler = new dead_sampler[sampled];
+
+  for (int64_t i = 0; i < sampled; i++) {
+      sampler[i].counter = new int64_t[dead_sampler_ways];
+      sampler[i].tag = new int64_t[dead_sampler_ways];
+      sampler[i].valid = new int64_t[dead_sampler_ways];
+      sampler[i].refs = new int64_t[dead_sampler_ways];
+      sampler[i].sig = new int64_t[dead_sampler_ways];
+      sampler[i].pred = new int64_t[dead_sampler_ways];
+
+      for (int64_t j = 0; j < dead_sampler_ways; j++) {
+          sampler[i].counter[j] = 0;
+          sampler[i].tag[j] = 0;
+          sampler[i].valid[j] = 0;
+          sampler[i].refs[j] = 0;
+          sampler[i].sig[j] = 0;
+          sampler[i].pred[j] = 0;
+      }
+  }
+
+  for (set_profile *p : {&L1_prof, &L2_prof}) {
+      int64_t sets = profile_on ? (p == &L1_prof ? L1_sets : L2_sets) : 0;
+      p->accesses = new uint64_t[sets];
+      p->misses = new uint64_t[sets];
+      p->evictions = new uint64_t[sets];
+      p->dirty_evictions = new uint64_t[sets];
+
+      for (int64_t i = 0; i < sets; i++) {
+          p->accesses[i] = 0;
+          p->misses[i] = 0;
+          p->evictions[i] = 0;
+          p->dirty_evictions[i] = 0;
+      }
+  }
+
+  sb = new stream_buffer[sb_count];
+
+  for (int64_t i = 0; i < sb_count; i++) {
+      sb[i].tag = new int64_t[sb_depth];
+      sb[i].valid = new int64_t[sb_depth];
+      sb[i].head = 0;
+      sb[i].next = 0;
+      sb[i].counter = 0;
+
+      for (int64_t j = 0; j < sb_depth; j++) {
+          sb[i].tag[j] = 0;
+          sb[i].valid[j] = 0;
+      }
   }
 }
 
-/** @brief Function to initialize your cache structures and any globals that you might need
- *
- *  @param addr The address being accessed
- *  @param rw Tell if the access is a read or a write
- *  @param stats Pointer to the cache statistics structure
- *
- */
-void cache_access(uint64_t addr, char rw, struct cache_stats_t *stats)
+template <class G>
+void access_kernel(uint64_t addr, char rw, struct cache_stats_t *stats)
 {
   stats->num_accesses++;
   if (rw == 'R') {
@@ -137,41 +549,85 @@ void cache_access(uint64_t addr, char rw, struct cache_stats_t *stats)
       stats->num_accesses_writes++;
   }
 
-  L1_tag = int64_t((addr >> (c - s))) & ((1 << (64 - c + s)) - 1);
-  L1_index = int64_t((addr >> b)) & ((1 << (c - b - s)) - 1);
+  L1_tag = int64_t((addr >> G::l1_tag_shift())) & L1_tag_mask;
+  L1_index = int64_t((addr >> G::block_bits())) & G::l1_set_mask();
 
-  vic_tag = int64_t((addr >> b)) & ((1 << (64 - b)) - 1);
+  vic_tag = int64_t((addr >> G::block_bits())) & vic_tag_mask;
 
-  L2_tag = int64_t((addr >> (C - S))) & ((1 << (64 - C + S)) - 1);
-  L2_index = int64_t((addr >> b)) & ((1 << (C - b - S)) - 1);
+  L2_tag = int64_t((addr >> G::l2_tag_shift())) & L2_tag_mask;
+  L2_index = int64_t((addr >> G::block_bits())) & G::l2_set_mask();
 
-  for (int64_t i = 0; i < L1_ways; i++) {
-      (L1.sets)[L1_index].counter[i]++;
+  if (G::hashed()) {
+      int64_t block = int64_t(addr >> G::block_bits()) & vic_tag_mask;
+      if (L1_index_fn != INDEX_BITS) {
+          L1_tag = block;
+          L1_index = L1_set_of(block);
+      }
+      if (L2_index_fn != INDEX_BITS) {
+          L2_tag = block;
+          L2_index = L2_set_of(block);
+      }
   }
 
-  for (int64_t i = 0; i < L2_ways; i++) {
-      (L2.sets)[L2_index].counter[i]++;
+  if (G::sectored()) {
+      L1_sector_bit = int64_t(1) << (int64_t(addr >> (G::block_bits() - L1_sector_bits)) & (L1_sectors - 1));
+      L2_sector_mask = L1_to_L2_sectors(L1_sector_bit);
+      L1_partial = -1;
+      vic_merge_sectors = 0;
+      vic_merge_dirty = 0;
   }
 
-  int64_t flag1 = L1_hit();
+  // skewed levels age every line through skew_clock instead
+  if (!G::hashed() || L1_index_fn != INDEX_SKEW) {
+      for (int64_t i = 0; i < G::l1_ways(); i++) {
+          (L1.sets)[L1_index].counter[i]++;
+      }
+  }
+
+  if (!G::filtering() && (!G::hashed() || L2_index_fn != INDEX_SKEW)) {
+      for (int64_t i = 0; i < G::l2_ways(); i++) {
+          (L2.sets)[L2_index].counter[i]++;
+      }
+  }
+
+  if (G::profiled()) {
+      L1_prof.accesses[L1_profile_set(L1_index, 0)]++;
+  }
+
+  int64_t flag1 = L1_hit<G>();
+
+  if (G::sectored() && flag1 != -1 && ((L1.sets)[L1_index].sectors[flag1] & L1_sector_bit) == 0) {
+      // tag hit but sector miss: counted as an L1 miss, refilled into the same line
+      stats->num_sector_misses_l1++;
+      L1_partial = flag1;
+      flag1 = -1;
+  }
 
   if (flag1 != -1) { // read/write hit in L1
+      cache_events::on_hit(LEVEL_L1, uint64_t(vic_tag));
       (L1.sets)[L1_index].tag[flag1] = L1_tag;
       (L1.sets)[L1_index].valid[flag1] = 1;
       int64_t min = 9999999999;
-      for (int64_t i = 0; i < L1_ways; i++) {
+      for (int64_t i = 0; i < G::l1_ways(); i++) {
           if ((L1.sets)[L1_index].counter[i] < min && (L1.sets)[L1_index].valid[i] == 1) {
               min = (L1.sets)[L1_index].counter[i];
           }
       }
 
-      (L1.sets)[L1_index].counter[flag1] = min - 1; // MRU
+      (L1.sets)[L1_index].counter[flag1] = L1_mru<G>(L1_index, min); // MRU
 
       if (rw == 'W') {
           (L1.sets)[L1_index].dirty[flag1] = 1;
+          if (G::sectored()) {
+              (L1.sets)[L1_index].sector_dirty[flag1] |= L1_sector_bit;
+          }
       }
   } else { // read/write miss in L1
       stats->num_misses_l1++;
+      cache_events::on_miss(LEVEL_L1, uint64_t(vic_tag));
+      if (G::profiled()) {
+          L1_prof.misses[L1_profile_set(L1_index, 0)]++;
+      }
       if (rw == 'R') {
           stats->num_misses_reads_l1++;
       } else {
@@ -179,6 +635,10 @@ void cache_access(uint64_t addr, char rw, struct cache_stats_t *stats)
       }
 
       if (v == 0) { // no vic
+          if (G::side_buffers() && side_hit<G>(rw, stats)) {
+              return;
+          }
+
           stats->num_misses_vc++;
           if (rw == 'R') {
               stats->num_misses_reads_vc++;
@@ -186,24 +646,24 @@ void cache_access(uint64_t addr, char rw, struct cache_stats_t *stats)
               stats->num_misses_writes_vc++;
           }
 
-          int64_t Flag = L2_hit(stats);
+          int64_t Flag = L2_hit<G>(stats);
 
           if (Flag != -1) { // read/write hit in L2
               int64_t min = 9999999999;
-              for (int64_t i = 0; i < L2_ways; i++) {
+              for (int64_t i = 0; i < G::l2_ways(); i++) {
                   if ((L2.sets)[L2_index].counter[i] < min && (L2.sets)[L2_index].valid[i] == 1) {
                       min = (L2.sets)[L2_index].counter[i];
                   }
               }
 
-              (L2.sets)[L2_index].counter[Flag] = min - 1; // MRU
+              (L2.sets)[L2_index].counter[Flag] = L2_mru<G>(L2_index, min); // MRU
               //(L2.sets)[L2_index].valid[Flag] = 1;
               //(L2.sets)[L2_index].tag[Flag] = L2_tag;
 
               if (rw == 'W') {
-                  install_to_L1_no(1, L1_tag, L1_index, stats);
+                  install_to_L1_no<G>(1, L1_tag, L1_index, stats);
               } else {
-                  install_to_L1_no((L2.sets)[L2_index].dirty[Flag], L1_tag, L1_index, stats);
+                  install_to_L1_no<G>((L2.sets)[L2_index].dirty[Flag], L1_tag, L1_index, stats);
               }
 
           } else { // read/write miss in L2
@@ -214,37 +674,42 @@ void cache_access(uint64_t addr, char rw, struct cache_stats_t *stats)
                   stats->num_misses_writes_l2++;
               }
 
-              install_to_L2(0, L2_tag, L2_index, stats);
+              install_to_L2<G>(0, L2_tag, L2_index, stats);
 
               if (rw == 'W') {
-                  install_to_L1_no(1, L1_tag, L1_index, stats);
+                  install_to_L1_no<G>(1, L1_tag, L1_index, stats);
               } else {
-                  install_to_L1_no(0, L1_tag, L1_index, stats);
+                  install_to_L1_no<G>(0, L1_tag, L1_index, stats);
               }
 
               // prefetch
               for (int64_t i = 1; i <= k ; i++) {
-                uint64_t temp = addr + uint64_t((1 << b) * i);
-                int64_t Tag = int64_t((temp >> (C - S))) & ((1 << (64 - C + S)) - 1);
-                int64_t Index = int64_t(temp >> b) & ((1 << (C - b - S)) - 1);
-                prefetch(Tag, Index, stats);
+                uint64_t temp = addr + uint64_t(G::block_size() * i);
+                int64_t Tag, Index;
+                L2_split<G>(int64_t(temp >> G::block_bits()), &Tag, &Index);
+                prefetch<G>(Tag, Index, stats);
               }
 
           }
+          if (G::side_buffers()) {
+              side_miss<G>(stats);
+          }
           return;
       }
 
 
 
 
-      int64_t flag2 = vic_hit();
+      // a block with a sector miss is still in L1, so it can't be in the vic
+      int64_t flag2 = (G::sectored() && L1_partial != -1) ? -1 : vic_hit<G>();
 
       if (flag2 != -1) { // read/write hit in vic
           stats->num_hits_vc++;
+          cache_events::on_hit(LEVEL_VC, uint64_t(vic_tag));
           // LRU of L1
           int64_t max = -9999999999;
           int64_t temp = -1;
-          for (int64_t i = 0; i < L1_ways; i++) {
+          for (int64_t i = 0; i < G::l1_ways(); i++) {
               if ((L1.sets)[L1_index].counter[i] > max && (L1.sets)[L1_index].valid[i] == 1) {
                   max = (L1.sets)[L1_index].counter[i];
                   temp = i;
@@ -252,19 +717,21 @@ void cache_access(uint64_t addr, char rw, struct cache_stats_t *stats)
           }
 
           // bookkeeping
-          int64_t Tag_L1_to_vic = ((L1.sets)[L1_index].tag[temp] << (c - s - b)) + L1_index;
+          profile_L1_evict<G>(L1_index, temp);
+          event_L1_evict<G>(L1_index, temp);
+          int64_t Tag_L1_to_vic = L1_block<G>((L1.sets)[L1_index].tag[temp], L1_index);
           int64_t Dirty_L1_to_vic = (L1.sets)[L1_index].dirty[temp];
 
 
           int64_t min = 9999999999;
-          for (int64_t i = 0; i < L1_ways; i++) {
+          for (int64_t i = 0; i < G::l1_ways(); i++) {
               if ((L1.sets)[L1_index].counter[i] < min && (L1.sets)[L1_index].valid[i] == 1) {
                   min = (L1.sets)[L1_index].counter[i];
               }
           }
 
           (L1.sets)[L1_index].tag[temp] = L1_tag;
-          (L1.sets)[L1_index].counter[temp] = min - 1;
+          (L1.sets)[L1_index].counter[temp] = L1_mru<G>(L1_index, min);
           (L1.sets)[L1_index].valid[temp] = 1;
 
           if (rw == 'W') {
@@ -273,6 +740,21 @@ void cache_access(uint64_t addr, char rw, struct cache_stats_t *stats)
               (L1.sets)[L1_index].dirty[temp] = vic.dirty[flag2];
           }
 
+          if (G::sectored()) { // swap the sector bits along with the blocks
+              int64_t Sectors_L1_to_vic = (L1.sets)[L1_index].sectors[temp];
+              int64_t Sector_dirty_L1_to_vic = (L1.sets)[L1_index].sector_dirty[temp];
+              (L1.sets)[L1_index].sectors[temp] = vic.sectors[flag2];
+              (L1.sets)[L1_index].sector_dirty[temp] = vic.sector_dirty[flag2] | (rw == 'W' ? L1_sector_bit : 0);
+              vic.sectors[flag2] = Sectors_L1_to_vic;
+              vic.sector_dirty[flag2] = Sector_dirty_L1_to_vic;
+          }
+
+          if (G::filtering()) {
+              int64_t Fill_L1_to_vic = (L1.sets)[L1_index].fill[temp];
+              (L1.sets)[L1_index].fill[temp] = vic.fill[flag2];
+              vic.fill[flag2] = Fill_L1_to_vic;
+          }
+
           int64_t Min = 9999999999;
           for (int64_t i = 0; i < v; i++) {
               if (vic.counter[i] < Min && vic.valid[i] == 1) {
@@ -284,12 +766,16 @@ void cache_access(uint64_t addr, char rw, struct cache_stats_t *stats)
           vic.dirty[flag2] = Dirty_L1_to_vic;
           vic.valid[flag2] = 1;
           vic.counter[flag2] = Min - 1;
+          cache_events::on_fill(LEVEL_L1, uint64_t(vic_tag));
+          cache_events::on_fill(LEVEL_VC, uint64_t(Tag_L1_to_vic));
 
 
       } else { // read/write miss in vic
+          cache_events::on_miss(LEVEL_VC, uint64_t(vic_tag));
 
-
-
+          if (G::side_buffers() && side_hit<G>(rw, stats)) {
+              return;
+          }
 
           stats->num_misses_vc++;
           if (rw == 'R') {
@@ -297,22 +783,22 @@ void cache_access(uint64_t addr, char rw, struct cache_stats_t *stats)
           } else {
               stats->num_misses_writes_vc++;
           }
-          int64_t flag3 = L2_hit(stats);
+          int64_t flag3 = L2_hit<G>(stats);
 
           if (flag3 != -1) { // read/write hit in l2
               int64_t min = 9999999999;
-              for (int64_t i = 0; i < L2_ways; i++) {
+              for (int64_t i = 0; i < G::l2_ways(); i++) {
                   if ((L2.sets)[L2_index].counter[i] < min && (L2.sets)[L2_index].valid[i] == 1) {
                       min = (L2.sets)[L2_index].counter[i];
                   }
               }
 
-              (L2.sets)[L2_index].counter[flag3] = min - 1; // MRU
+              (L2.sets)[L2_index].counter[flag3] = L2_mru<G>(L2_index, min); // MRU
 
               if (rw == 'W') {
-                  install_to_L1(1, L1_tag, L1_index, stats);
+                  install_to_L1<G>(1, L1_tag, L1_index, stats);
               } else {
-                  install_to_L1((L2.sets)[L2_index].dirty[flag3], L1_tag, L1_index, stats);
+                  install_to_L1<G>((L2.sets)[L2_index].dirty[flag3], L1_tag, L1_index, stats);
               }
           } else { // read/write miss in l2
               stats->num_misses_l2++;
@@ -321,33 +807,50 @@ void cache_access(uint64_t addr, char rw, struct cache_stats_t *stats)
               } else {
                   stats->num_misses_writes_l2++;
               }
-              install_to_L2(0, L2_tag, L2_index, stats);
+              install_to_L2<G>(0, L2_tag, L2_index, stats);
 
               if (rw == 'W') {
-                  install_to_L1(1, L1_tag, L1_index, stats);
+                  install_to_L1<G>(1, L1_tag, L1_index, stats);
               } else {
-                  install_to_L1(0, L1_tag, L1_index, stats);
+                  install_to_L1<G>(0, L1_tag, L1_index, stats);
               }
 
               // prefetch
               for (int64_t i = 1; i <= k; i++) {
-                uint64_t temp = addr + uint64_t((1 << b) * i);
-                int64_t Tag = int64_t((temp >> (C - S))) & ((1 << (64 - C + S)) - 1);
-                int64_t Index = int64_t(temp >> b) & ((1 << (C - b - S)) - 1);
-                prefetch(Tag, Index, stats);
+                uint64_t temp = addr + uint64_t(G::block_size() * i);
+                int64_t Tag, Index;
+                L2_split<G>(int64_t(temp >> G::block_bits()), &Tag, &Index);
+                prefetch<G>(Tag, Index, stats);
               }
           }
+          if (G::side_buffers()) {
+              side_miss<G>(stats);
+          }
       }
   }
 }
 
+template <class G>
 void install_to_L1_no(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats_t *stats) { // MRU
 
-	for (int64_t i = 0; i < L1_ways; i++) { // find empty space
+	if (G::sectored() && L1_partial != -1) { // block already here, add the sector
+		int64_t min = 9999999999;
+		for (int64_t j = 0; j < G::l1_ways(); j++) {
+			if ((L1.sets)[index].counter[j] < min && (L1.sets)[index].valid[j] == 1) {
+				min = (L1.sets)[index].counter[j];
+			}
+		}
+		(L1.sets)[index].counter[L1_partial] = L1_mru<G>(index, min); // MRU
+		fill_L1_sectors<G>(isDirty, index, L1_partial, true);
+		cache_events::on_fill(LEVEL_L1, uint64_t(L1_block<G>(tag, index)));
+		return;
+	}
+
+	for (int64_t i = 0; i < G::l1_ways(); i++) { // find empty space
 		if ((L1.sets)[index].valid[i] == 0) {
 
 			int64_t min = 9999999999;
-			for (int64_t j = 0; j < L1_ways; j++) {
+			for (int64_t j = 0; j < G::l1_ways(); j++) {
 				if ((L1.sets)[index].counter[j] < min && (L1.sets)[index].valid[j] == 1) {
 					min = (L1.sets)[index].counter[j];
 				}
@@ -355,7 +858,12 @@ void install_to_L1_no(int64_t isDirty, int64_t tag, int64_t index, struct cache_
 			(L1.sets)[index].valid[i] = 1;
 	  		(L1.sets)[index].tag[i] = tag;
 			(L1.sets)[index].dirty[i] = isDirty;
-			(L1.sets)[index].counter[i] = min - 1; // MRU
+			(L1.sets)[index].counter[i] = L1_mru<G>(index, min); // MRU
+			fill_L1_sectors<G>(isDirty, index, i, false);
+			cache_events::on_fill(LEVEL_L1, uint64_t(L1_block<G>(tag, index)));
+			if (G::filtering()) {
+				(L1.sets)[index].fill[i] = filter_records;
+			}
 
 			return;
 		}
@@ -364,24 +872,30 @@ void install_to_L1_no(int64_t isDirty, int64_t tag, int64_t index, struct cache_
 	// full
 	int64_t max = -9999999999;
 	int64_t temp = -1;
-	for (int64_t i = 0; i < L1_ways; i++) {
+	for (int64_t i = 0; i < G::l1_ways(); i++) {
 		if ((L1.sets)[index].counter[i] > max && (L1.sets)[index].valid[i] == 1) {
 			max = (L1.sets)[index].counter[i];
 			temp = i;
 		}
 	}
 
+	profile_L1_evict<G>(index, temp);
+	event_L1_evict<G>(index, temp);
+	if (G::filtering()) {
+		filter_leave(L1_block<G>((L1.sets)[index].tag[temp], index), (L1.sets)[index].dirty[temp], (L1.sets)[index].fill[temp]);
+	}
+
 	if ((L1.sets)[index].dirty[temp] == 1 && (L1.sets)[index].valid[temp] == 1) {
-				int64_t concate = ((L1.sets)[index].tag[temp] << (c - b - s)) + index;
-				int64_t Tag = (concate >> (C - S - b)) & ((1 << (64 - C + S)) - 1);
-				int64_t Index = concate & ((1 << (C - S - b)) - 1);
-				evict_to_L2(1, Tag, Index, stats);
+				int64_t Tag, Index;
+				L2_split<G>(L1_block<G>((L1.sets)[index].tag[temp], index), &Tag, &Index);
+				cache_events::on_write_back(LEVEL_L1, uint64_t(L1_block<G>((L1.sets)[index].tag[temp], index)));
+				evict_to_L2<G>(1, Tag, Index, (L1.sets)[index].sector_dirty[temp], stats);
 	}
 
 
 
 	int64_t min = 9999999999;
-	for (int64_t i = 0; i < L1_ways; i++) {
+	for (int64_t i = 0; i < G::l1_ways(); i++) {
 		if ((L1.sets)[index].counter[i] < min && (L1.sets)[index].valid[i] == 1) {
 			min = (L1.sets)[index].counter[i];
 		}
@@ -389,14 +903,20 @@ void install_to_L1_no(int64_t isDirty, int64_t tag, int64_t index, struct cache_
 	(L1.sets)[index].valid[temp] = 1;
 	(L1.sets)[index].tag[temp] = tag;
 	(L1.sets)[index].dirty[temp] = isDirty;
-	(L1.sets)[index].counter[temp] = min - 1; // MRU
+	(L1.sets)[index].counter[temp] = L1_mru<G>(index, min); // MRU
+	fill_L1_sectors<G>(isDirty, index, temp, false);
+	cache_events::on_fill(LEVEL_L1, uint64_t(L1_block<G>(tag, index)));
+	if (G::filtering()) {
+		(L1.sets)[index].fill[temp] = filter_records;
+	}
 
 }
 
 
 
+template <class G>
 int64_t L1_hit() {
-    	for (int64_t i = 0; i < L1_ways; i++) {
+    	for (int64_t i = 0; i < G::l1_ways(); i++) {
         	if ((L1.sets)[L1_index].tag[i] == L1_tag && (L1.sets)[L1_index].valid[i] == 1) {
             		return i;
         	}
@@ -404,43 +924,96 @@ int64_t L1_hit() {
 	return -1;
 }
 
+template <class G>
 int64_t vic_hit() {
 	for (int64_t i = 0; i < v; i++) {
 		if (vic.tag[i] == vic_tag && vic.valid[i] == 1) {
+			if (G::sectored() && (vic.sectors[i] & L1_sector_bit) == 0) {
+				// sector miss: the block moves back to L1 with the sectors it has
+				vic_merge_sectors |= vic.sectors[i];
+				vic_merge_dirty |= vic.sector_dirty[i];
+				vic.valid[i] = 0;
+				continue;
+			}
 			return i;
 		}
 	}
 	return -1;
 }
 
+template <class G>
 int64_t L2_hit(struct cache_stats_t *stats) {
-    for (int64_t i = 0; i < L2_ways; i++) {
+    if (G::filtering()) { // recorded instead, and treated as a miss so a read fills L1 clean
+        filter_lookup = true;
+        return -1;
+    }
+    L2_partial = -1;
+    if (G::dead_blocks()) {
+        dead_sample(L2_block<G>(L2_tag, L2_index), stats);
+    }
+    if (G::profiled()) {
+        L2_prof.accesses[L2_profile_set(L2_index, 0)]++;
+    }
+    for (int64_t i = 0; i < G::l2_ways(); i++) {
     		if ((L2.sets)[L2_index].tag[i] == L2_tag && (L2.sets)[L2_index].valid[i] == 1) {
+						if (G::sectored() && ((L2.sets)[L2_index].sectors[i] & L2_sector_mask) != L2_sector_mask) {
+								L2_partial = i; // tag hit, sector miss
+								cache_events::on_miss(LEVEL_L2, uint64_t(L2_block<G>(L2_tag, L2_index)));
+								if (G::profiled()) {
+										L2_prof.misses[L2_profile_set(L2_index, 0)]++;
+								}
+								return -1;
+						}
 						if ((L2.sets)[L2_index].prefetch[i] == 1) {
 								stats->num_useful_prefetches++;
+								cache_events::on_prefetch_use(LEVEL_L2, uint64_t(L2_block<G>(L2_tag, L2_index)));
 								(L2.sets)[L2_index].prefetch[i] = 0;
 						}
+						if (G::dead_blocks()) {
+								(L2.sets)[L2_index].refs[i]++;
+								(L2.sets)[L2_index].dead[i] = dead_predict(L2_block<G>(L2_tag, L2_index), (L2.sets)[L2_index].refs[i]);
+						}
+						cache_events::on_hit(LEVEL_L2, uint64_t(L2_block<G>(L2_tag, L2_index)));
             return i;
         }
 		}
+		cache_events::on_miss(LEVEL_L2, uint64_t(L2_block<G>(L2_tag, L2_index)));
+		if (G::profiled()) {
+				L2_prof.misses[L2_profile_set(L2_index, 0)]++;
+		}
 		return -1;
 }
 
+template <class G>
 void prefetch(int64_t tag, int64_t index, struct cache_stats_t *stats) { // LRU
+	if (G::filtering()) {
+		return;
+	}
 
-	for (int64_t i = 0; i < L2_ways; i++) {
+	for (int64_t i = 0; i < G::l2_ways(); i++) {
 		if ((L2.sets)[index].tag[i] == tag && (L2.sets)[index].valid[i] == 1) {
+				int64_t missing = L2_sector_mask & ~(L2.sets)[index].sectors[i];
+				if (G::sectored() && missing != 0) { // fetch just the missing sectors
+						stats->num_prefetches++;
+						stats->num_bytes_transferred += uint64_t(count_sectors(missing));
+						mem_request<G>(tag, index, DRAM_PREFETCH, stats);
+						cache_events::on_prefetch_issue(LEVEL_L2, uint64_t(L2_block<G>(tag, index)));
+						(L2.sets)[index].sectors[i] |= missing;
+						(L2.sets)[index].prefetch[i] = 1;
+				}
 				return;
 		}
 	}
 	stats->num_prefetches++;
-	stats->num_bytes_transferred++; // prefetch
+	stats->num_bytes_transferred += fill_units<G>(); // prefetch
+	mem_request<G>(tag, index, DRAM_PREFETCH, stats);
+	cache_events::on_prefetch_issue(LEVEL_L2, uint64_t(L2_block<G>(tag, index)));
 
-	for (int64_t i = 0; i < L2_ways; i++) {
+	for (int64_t i = 0; i < G::l2_ways(); i++) {
 		if ((L2.sets)[index].valid[i] == 0) { // find empty space
 
 			int64_t max = -9999999999;
-			for (int64_t j = 0; j < L2_ways; j++) {
+			for (int64_t j = 0; j < G::l2_ways(); j++) {
 				if ((L2.sets)[index].counter[j] > max && (L2.sets)[index].valid[j] == 1) {
 					max = (L2.sets)[index].counter[j];
 				}
@@ -450,6 +1023,11 @@ void prefetch(int64_t tag, int64_t index, struct cache_stats_t *stats) { // LRU
 			(L2.sets)[index].dirty[i] = 0;
 			(L2.sets)[index].prefetch[i] = 1;
 			(L2.sets)[index].counter[i] = max + 1; // LRU
+			(L2.sets)[index].sectors[i] = L2_sector_mask;
+			(L2.sets)[index].sector_dirty[i] = 0;
+			dead_fill<G>(index, i);
+			cache_events::on_fill(LEVEL_L2, uint64_t(L2_block<G>(tag, index)));
+			compress_fit<G>(index, i, stats);
 
 			return;
 		}
@@ -458,16 +1036,22 @@ void prefetch(int64_t tag, int64_t index, struct cache_stats_t *stats) { // LRU
 	// full
 	int64_t max = -9999999999;
 	int64_t temp = -1;
-	for (int64_t i = 0; i < L2_ways; i++) {
+	for (int64_t i = 0; i < G::l2_ways(); i++) {
 		if ((L2.sets)[index].counter[i] > max && (L2.sets)[index].valid[i] == 1) {
 			max = (L2.sets)[index].counter[i];
 			temp = i;
 		}
 	}
+	if (G::dead_blocks()) {
+		temp = dead_victim<G>(index, temp, stats);
+	}
+	profile_L2_evict<G>(index, temp);
+	event_L2_evict<G>(index, temp);
 
 	if ((L2.sets)[index].dirty[temp] == 1) {
 		stats->num_write_backs++;
-		stats->num_bytes_transferred++; // write back
+		stats->num_bytes_transferred += write_back_units<G>(index, temp); // write back
+		mem_request<G>((L2.sets)[index].tag[temp], index, DRAM_WRITE, stats);
 	}
 
 	(L2.sets)[index].tag[temp] = tag;
@@ -475,15 +1059,34 @@ void prefetch(int64_t tag, int64_t index, struct cache_stats_t *stats) { // LRU
 	(L2.sets)[index].dirty[temp] = 0;
 	(L2.sets)[index].prefetch[temp] = 1;
 	(L2.sets)[index].counter[temp] = max + 1; // LRU
+	(L2.sets)[index].sectors[temp] = L2_sector_mask;
+	(L2.sets)[index].sector_dirty[temp] = 0;
+	dead_fill<G>(index, temp);
+	cache_events::on_fill(LEVEL_L2, uint64_t(L2_block<G>(tag, index)));
+	compress_fit<G>(index, temp, stats);
 }
 
+template <class G>
 void install_to_L1(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats_t *stats) { // MRU
 
-	for (int64_t i = 0; i < L1_ways; i++) { // find empty space
+	if (G::sectored() && L1_partial != -1) { // block already here, add the sector
+		int64_t min = 9999999999;
+		for (int64_t j = 0; j < G::l1_ways(); j++) {
+			if ((L1.sets)[index].counter[j] < min && (L1.sets)[index].valid[j] == 1) {
+				min = (L1.sets)[index].counter[j];
+			}
+		}
+		(L1.sets)[index].counter[L1_partial] = L1_mru<G>(index, min); // MRU
+		fill_L1_sectors<G>(isDirty, index, L1_partial, true);
+		cache_events::on_fill(LEVEL_L1, uint64_t(L1_block<G>(tag, index)));
+		return;
+	}
+
+	for (int64_t i = 0; i < G::l1_ways(); i++) { // find empty space
 		if ((L1.sets)[index].valid[i] == 0) {
 
 			int64_t min = 9999999999;
-			for (int64_t j = 0; j < L1_ways; j++) {
+			for (int64_t j = 0; j < G::l1_ways(); j++) {
 				if ((L1.sets)[index].counter[j] < min && (L1.sets)[index].valid[j] == 1) {
 					min = (L1.sets)[index].counter[j];
 				}
@@ -491,7 +1094,12 @@ void install_to_L1(int64_t isDirty, int64_t tag, int64_t index, struct cache_sta
 			(L1.sets)[index].valid[i] = 1;
 	  		(L1.sets)[index].tag[i] = tag;
 			(L1.sets)[index].dirty[i] = isDirty;
-			(L1.sets)[index].counter[i] = min - 1; // MRU
+			(L1.sets)[index].counter[i] = L1_mru<G>(index, min); // MRU
+			fill_L1_sectors<G>(isDirty, index, i, false);
+			cache_events::on_fill(LEVEL_L1, uint64_t(L1_block<G>(tag, index)));
+			if (G::filtering()) {
+				(L1.sets)[index].fill[i] = filter_records;
+			}
 
 			return;
 		}
@@ -500,19 +1108,21 @@ void install_to_L1(int64_t isDirty, int64_t tag, int64_t index, struct cache_sta
 	// full
 	int64_t max = -9999999999;
 	int64_t temp = -1;
-	for (int64_t i = 0; i < L1_ways; i++) {
+	for (int64_t i = 0; i < G::l1_ways(); i++) {
 		if ((L1.sets)[index].counter[i] > max && (L1.sets)[index].valid[i] == 1) {
 			max = (L1.sets)[index].counter[i];
 			temp = i;
 		}
 	}
 
+	profile_L1_evict<G>(index, temp);
+	event_L1_evict<G>(index, temp);
 	int64_t Dirty = (L1.sets)[index].dirty[temp];
-	int64_t Tag = ((L1.sets)[index].tag[temp] << (c - s - b)) + index;
-	evict_to_vic(Dirty, Tag, stats);
+	int64_t Tag = L1_block<G>((L1.sets)[index].tag[temp], index);
+	evict_to_vic<G>(Dirty, Tag, (L1.sets)[index].sectors[temp], (L1.sets)[index].sector_dirty[temp], (L1.sets)[index].fill[temp], stats);
 
 	int64_t min = 9999999999;
-	for (int64_t i = 0; i < L1_ways; i++) {
+	for (int64_t i = 0; i < G::l1_ways(); i++) {
 		if ((L1.sets)[index].counter[i] < min && (L1.sets)[index].valid[i] == 1) {
 			min = (L1.sets)[index].counter[i];
 		}
@@ -520,11 +1130,17 @@ void install_to_L1(int64_t isDirty, int64_t tag, int64_t index, struct cache_sta
 	(L1.sets)[index].valid[temp] = 1;
 	(L1.sets)[index].tag[temp] = tag;
 	(L1.sets)[index].dirty[temp] = isDirty;
-	(L1.sets)[index].counter[temp] = min - 1; // MRU
+	(L1.sets)[index].counter[temp] = L1_mru<G>(index, min); // MRU
+	fill_L1_sectors<G>(isDirty, index, temp, false);
+	cache_events::on_fill(LEVEL_L1, uint64_t(L1_block<G>(tag, index)));
+	if (G::filtering()) {
+		(L1.sets)[index].fill[temp] = filter_records;
+	}
 
 }
 
-void evict_to_vic(int64_t isDirty, int64_t tag, struct cache_stats_t *stats) { // FIFO
+template <class G>
+void evict_to_vic(int64_t isDirty, int64_t tag, int64_t sectors, int64_t sector_dirty, int64_t fill, struct cache_stats_t *stats) { // FIFO
 
 	for (int64_t i = 0; i < v; i++) {
 			if (vic.valid[i] == 0) { // find empty space
@@ -539,6 +1155,9 @@ void evict_to_vic(int64_t isDirty, int64_t tag, struct cache_stats_t *stats) { /
 					vic.valid[i] = 1;
 					vic.dirty[i] = isDirty;
 					vic.tag[i] = tag;
+					vic.sectors[i] = sectors;
+					vic.sector_dirty[i] = sector_dirty;
+					vic.fill[i] = fill;
 			}
 	}
 
@@ -553,10 +1172,16 @@ void evict_to_vic(int64_t isDirty, int64_t tag, struct cache_stats_t *stats) { /
 			}
 	}
 
+	if (G::filtering()) {
+		filter_leave(vic.tag[temp], vic.dirty[temp], vic.fill[temp]);
+	}
+	cache_events::on_evict(LEVEL_VC, uint64_t(vic.tag[temp]), vic.dirty[temp] == 1);
+
 	if (vic.dirty[temp] == 1) {
-		int64_t Tag = (vic.tag[temp] >> (C - S - b)) & ((1 << (64 - C + S)) - 1);
-		int64_t Index = vic.tag[temp] & ((1 << (C - S - b)) - 1);
-		evict_to_L2(1, Tag, Index, stats);
+		int64_t Tag, Index;
+		L2_split<G>(vic.tag[temp], &Tag, &Index);
+		cache_events::on_write_back(LEVEL_VC, uint64_t(vic.tag[temp]));
+		evict_to_L2<G>(1, Tag, Index, vic.sector_dirty[temp], stats);
 	}
 
   int64_t min = 9999999999;
@@ -570,15 +1195,47 @@ void evict_to_vic(int64_t isDirty, int64_t tag, struct cache_stats_t *stats) { /
 	vic.valid[temp] = 1;
 	vic.tag[temp] = tag;
 	vic.counter[temp] = min - 1;
+	vic.sectors[temp] = sectors;
+	vic.sector_dirty[temp] = sector_dirty;
+	vic.fill[temp] = fill;
+	cache_events::on_fill(LEVEL_VC, uint64_t(tag));
 }
 
+template <class G>
 void install_to_L2(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats_t *stats) { // MRU
-	stats->num_bytes_transferred++; // miss repair
-	for (int64_t i = 0; i < L2_ways; i++) {
+	if (G::filtering()) {
+		return;
+	}
+	if (G::sectored() && L2_partial != -1) { // tag hit, sector miss: fill into the same line
+		int64_t missing = L2_sector_mask & ~(L2.sets)[index].sectors[L2_partial];
+		stats->num_sector_misses_l2++;
+		stats->num_bytes_transferred += uint64_t(count_sectors(missing));
+		mem_request<G>(tag, index, DRAM_READ, stats);
+
+		int64_t min = 9999999999;
+		for (int64_t j = 0; j < G::l2_ways(); j++) {
+			if ((L2.sets)[index].counter[j] < min && (L2.sets)[index].valid[j] == 1) {
+				min = (L2.sets)[index].counter[j];
+			}
+		}
+		(L2.sets)[index].counter[L2_partial] = L2_mru<G>(index, min); // MRU
+		(L2.sets)[index].sectors[L2_partial] |= missing;
+		(L2.sets)[index].prefetch[L2_partial] = 0;
+		cache_events::on_fill(LEVEL_L2, uint64_t(L2_block<G>(tag, index)));
+		return;
+	}
+
+	stats->num_bytes_transferred += fill_units<G>(); // miss repair
+	mem_request<G>(tag, index, DRAM_READ, stats);
+	if (G::dead_blocks() && dead_predict(L2_block<G>(tag, index), 0)) { // dead on arrival, L1 only
+		stats->num_dead_bypasses++;
+		return;
+	}
+	for (int64_t i = 0; i < G::l2_ways(); i++) {
 		if ((L2.sets)[index].valid[i] == 0) { // find empty space
 
 			int64_t min = 9999999999;
-			for (int64_t j = 0; j < L2_ways; j++) {
+			for (int64_t j = 0; j < G::l2_ways(); j++) {
 				if ((L2.sets)[index].counter[j] < min && (L2.sets)[index].valid[j] == 1) {
 					min = (L2.sets)[index].counter[j];
 				}
@@ -586,8 +1243,13 @@ void install_to_L2(int64_t isDirty, int64_t tag, int64_t index, struct cache_sta
 			(L2.sets)[index].valid[i] = 1;
 	  		(L2.sets)[index].tag[i] = tag;
 			(L2.sets)[index].dirty[i] = isDirty;
-			(L2.sets)[index].counter[i] = min - 1; // MRU
+			(L2.sets)[index].counter[i] = L2_mru<G>(index, min); // MRU
 			(L2.sets)[index].prefetch[i] = 0;
+			(L2.sets)[index].sectors[i] = L2_sector_mask;
+			(L2.sets)[index].sector_dirty[i] = isDirty ? L2_sector_mask : 0;
+			dead_fill<G>(index, i);
+			cache_events::on_fill(LEVEL_L2, uint64_t(L2_block<G>(tag, index)));
+			compress_fit<G>(index, i, stats);
 
 			return;
 		}
@@ -596,20 +1258,26 @@ void install_to_L2(int64_t isDirty, int64_t tag, int64_t index, struct cache_sta
 	// full
 	int64_t max = -9999999999;
 	int64_t temp = -1;
-	for (int64_t i = 0; i < L2_ways; i++) {
+	for (int64_t i = 0; i < G::l2_ways(); i++) {
 		if ((L2.sets)[index].counter[i] > max && (L2.sets)[index].valid[i] == 1) {
 			max = (L2.sets)[index].counter[i];
 			temp = i;
 		}
 	}
+	if (G::dead_blocks()) {
+		temp = dead_victim<G>(index, temp, stats);
+	}
+	profile_L2_evict<G>(index, temp);
+	event_L2_evict<G>(index, temp);
 
 	if ((L2.sets)[index].dirty[temp] == 1) {
 		stats->num_write_backs++;
-		stats->num_bytes_transferred++;
+		stats->num_bytes_transferred += write_back_units<G>(index, temp);
+		mem_request<G>((L2.sets)[index].tag[temp], index, DRAM_WRITE, stats);
 	}
 
 	int64_t min = 9999999999;
-	for (int64_t i = 0; i < L2_ways; i++) {
+	for (int64_t i = 0; i < G::l2_ways(); i++) {
 		if ((L2.sets)[index].counter[i] < min && (L2.sets)[index].valid[i] == 1) {
 			min = (L2.sets)[index].counter[i];
 		}
@@ -617,23 +1285,38 @@ void install_to_L2(int64_t isDirty, int64_t tag, int64_t index, struct cache_sta
 	(L2.sets)[index].tag[temp] = tag;
 	(L2.sets)[index].valid[temp] = 1;
 	(L2.sets)[index].dirty[temp] = isDirty;
-	(L2.sets)[index].counter[temp] = min - 1;
+	(L2.sets)[index].counter[temp] = L2_mru<G>(index, min);
 		(L2.sets)[index].prefetch[temp] = 0;
+	(L2.sets)[index].sectors[temp] = L2_sector_mask;
+	(L2.sets)[index].sector_dirty[temp] = isDirty ? L2_sector_mask : 0;
+	dead_fill<G>(index, temp);
+	cache_events::on_fill(LEVEL_L2, uint64_t(L2_block<G>(tag, index)));
+	compress_fit<G>(index, temp, stats);
 }
 
-void evict_to_L2(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats_t *stats) { // LRU
-	for (int64_t i = 0; i < L2_ways; i++) {
+template <class G>
+void evict_to_L2(int64_t isDirty, int64_t tag, int64_t index, int64_t sector_dirty, struct cache_stats_t *stats) { // LRU
+	if (G::filtering()) {
+		return;
+	}
+	if (G::side_buffers()) { // the side copies are stale now
+		side_invalidate(L2_block<G>(tag, index));
+	}
+	int64_t written = G::sectored() ? L1_to_L2_sectors(sector_dirty) : 0; // sectors carried by the write back
+	for (int64_t i = 0; i < G::l2_ways(); i++) {
 		if ((L2.sets)[index].valid[i] == 1 && (L2.sets)[index].tag[i] == tag) {
 				(L2.sets)[index].dirty[i] = 1;
+				(L2.sets)[index].sectors[i] |= written;
+				(L2.sets)[index].sector_dirty[i] |= written;
 				return;
 		}
 	}
 
-	for (int64_t i = 0; i < L2_ways; i++) { // find empty space
+	for (int64_t i = 0; i < G::l2_ways(); i++) { // find empty space
 		if ((L2.sets)[index].valid[i] == 0) {
 
 			int64_t max = -9999999999;
-			for (int64_t j = 0; j < L2_ways; j++) {
+			for (int64_t j = 0; j < G::l2_ways(); j++) {
 				if ((L2.sets)[index].counter[j] > max && (L2.sets)[index].valid[j] == 1) {
 						max = (L2.sets)[index].counter[j];
 				}
@@ -643,6 +1326,11 @@ void evict_to_L2(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats
 			(L2.sets)[index].dirty[i] = isDirty;
 			(L2.sets)[index].counter[i] = max + 1; // LRU
 			(L2.sets)[index].prefetch[i] = 0;
+			(L2.sets)[index].sectors[i] = written;
+			(L2.sets)[index].sector_dirty[i] = written;
+			dead_fill<G>(index, i);
+			cache_events::on_fill(LEVEL_L2, uint64_t(L2_block<G>(tag, index)));
+			compress_fit<G>(index, i, stats);
 
 			return;
 		}
@@ -651,16 +1339,22 @@ void evict_to_L2(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats
 	// full
 	int64_t max = -9999999999;
 	int64_t temp = -1;
-	for (int64_t i = 0; i < L2_ways; i++) {
+	for (int64_t i = 0; i < G::l2_ways(); i++) {
 		if ((L2.sets)[index].counter[i] > max && (L2.sets)[index].valid[i] == 1) {
 			max = (L2.sets)[index].counter[i];
 			temp = i;
 		}
 	}
+	if (G::dead_blocks()) {
+		temp = dead_victim<G>(index, temp, stats);
+	}
+	profile_L2_evict<G>(index, temp);
+	event_L2_evict<G>(index, temp);
 
 	if ((L2.sets)[index].dirty[temp] == 1 && (L2.sets)[index].valid[temp] == 1) {
 		stats->num_write_backs++;
-		stats->num_bytes_transferred++;
+		stats->num_bytes_transferred += write_back_units<G>(index, temp);
+		mem_request<G>((L2.sets)[index].tag[temp], index, DRAM_WRITE, stats);
 	}
 
 	(L2.sets)[index].valid[temp] = 1;
@@ -668,6 +1362,1070 @@ void evict_to_L2(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats
 	(L2.sets)[index].dirty[temp] = isDirty;
 	(L2.sets)[index].counter[temp] = max + 1; // LRU
 	(L2.sets)[index].prefetch[temp] = 0;
+	(L2.sets)[index].sectors[temp] = written;
+	(L2.sets)[index].sector_dirty[temp] = written;
+	dead_fill<G>(index, temp);
+	cache_events::on_fill(LEVEL_L2, uint64_t(L2_block<G>(tag, index)));
+	compress_fit<G>(index, temp, stats);
+}
+
+/** @brief Function to initialize your cache structures and any globals that you might need
+ *
+ *  @param addr The address being accessed
+ *  @param rw Tell if the access is a read or a write
+ *  @param stats Pointer to the cache statistics structure
+ *
+ */
+void cache_access(uint64_t addr, char rw, struct cache_stats_t *stats)
+{
+  access_dispatch(addr, rw, stats);
+}
+
+// Accesses per block of a batch, and how far ahead of the access being
+// simulated its sets are prefetched. The set structs are prefetched twice as
+// far ahead as the arrays they point to, so the pointers are in the host
+// cache by the time they are followed.
+static const size_t BATCH_BLOCK = 64;
+static const size_t BATCH_DISTANCE = 4;
+
+// Set an access is likely to touch, without gathering anything. For a skewed
+// level that is the set of way 0.
+static int64_t batch_set(uint64_t addr, int64_t fn, int64_t set_bits, int64_t prime)
+{
+  int64_t block = int64_t(addr >> b) & vic_tag_mask;
+  if (fn == INDEX_SKEW) {
+      return skew_hash(block, set_bits, 0);
+  }
+  return hashed_index(block, fn, set_bits, prime);
+}
+
+/** @brief Simulates a batch of accesses, in order, exactly as cache_access would
+ *
+ *  The set indices of each block of accesses are computed up front so the
+ *  tag, counter and valid arrays of upcoming sets can be prefetched into the
+ *  host cache while earlier accesses are being simulated.
+ *
+ *  @param addrs The addresses being accessed
+ *  @param rw READ or WRITE for each access
+ *  @param n Number of accesses
+ *  @param stats Pointer to the cache statistics structure
+ *
+ */
+void cache_access_batch(const uint64_t *addrs, const char *rw, size_t n, struct cache_stats_t *stats)
+{
+  int64_t L1_idx[BATCH_BLOCK + 2 * BATCH_DISTANCE];
+  int64_t L2_idx[BATCH_BLOCK + 2 * BATCH_DISTANCE];
+
+  for (size_t base = 0; base < n; base += BATCH_BLOCK) {
+      size_t len = n - base < BATCH_BLOCK ? n - base : BATCH_BLOCK;
+      size_t ahead = n - base - len < 2 * BATCH_DISTANCE ? n - base - len : 2 * BATCH_DISTANCE;
+
+      // indices for this block plus the lookahead into the next one
+      for (size_t i = 0; i < len + ahead; i++) {
+          L1_idx[i] = batch_set(addrs[base + i], L1_index_fn, c - s - b, L1_prime);
+          L2_idx[i] = batch_set(addrs[base + i], L2_index_fn, C - S - b, L2_prime);
+      }
+
+      for (size_t i = 0; i < len; i++) {
+          if (i + 2 * BATCH_DISTANCE < len + ahead) {
+              __builtin_prefetch(&(L1.sets)[L1_idx[i + 2 * BATCH_DISTANCE]]);
+              __builtin_prefetch(&(L2.sets)[L2_idx[i + 2 * BATCH_DISTANCE]]);
+          }
+          if (i + BATCH_DISTANCE < len + ahead) {
+              L1_set &l1 = (L1.sets)[L1_idx[i + BATCH_DISTANCE]];
+              L2_set &l2 = (L2.sets)[L2_idx[i + BATCH_DISTANCE]];
+              __builtin_prefetch(l1.tag);
+              __builtin_prefetch(l1.valid);
+              __builtin_prefetch(l1.counter, 1);
+              __builtin_prefetch(l2.tag);
+              __builtin_prefetch(l2.valid);
+              __builtin_prefetch(l2.counter, 1);
+          }
+          access_dispatch(addrs[base + i], rw[base + i], stats);
+      }
+  }
+}
+
+static void put_varint(uint64_t x)
+{
+  while (x >= 0x80) {
+      fputc(int(x & 0x7f) | 0x80, filter_out);
+      x >>= 7;
+  }
+  fputc(int(x), filter_out);
+}
+
+static bool get_varint(FILE *in, uint64_t *x)
+{
+  *x = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+      int ch = getc(in);
+      if (ch == EOF) {
+          return false;
+      }
+      *x |= uint64_t(ch & 0x7f) << shift;
+      if ((ch & 0x80) == 0) {
+          return true;
+      }
+  }
+  return false;
+}
+
+void filter_leave(int64_t block, int64_t dirty, int64_t fill)
+{
+  filter_leave_block = block;
+  filter_leave_dirty = dirty;
+  filter_leave_fill = fill;
+}
+
+// At most one line leaves L1+VC per access, and only on an access that
+// looked up the L2, so every access writes at most one record
+void filter_access(uint64_t addr, char rw, struct cache_stats_t *stats)
+{
+  skew_clock++;
+  filter_lookup = false;
+  filter_leave_block = -1;
+  filter_leave_dirty = 0;
+  access_kernel<filter_geometry>(addr, rw, stats);
+  skew_release();
+
+  if (filter_lookup) {
+      int flags = (rw == 'W' ? FR_WRITE : 0) | (filter_leave_block != -1 ? FR_LEAVE : 0) |
+                  (filter_leave_dirty == 1 ? FR_LEAVE_DIRTY : 0);
+      fputc(flags, filter_out);
+      put_varint(uint64_t(skew_clock - filter_last));
+      fwrite(&addr, sizeof(addr), 1, filter_out);
+      if (filter_leave_block != -1) {
+          put_varint(uint64_t(filter_leave_block));
+          put_varint(uint64_t(filter_records - filter_leave_fill));
+      }
+      filter_last = skew_clock;
+      filter_records++;
+  }
+}
+
+/** @brief Sets up the L1 and VC of a configuration to write an L1-filtered trace
+ *
+ *  Accesses then go through cache_access or cache_access_batch as usual. The
+ *  L2, prefetcher and DRAM settings are ignored.
+ *
+ *  @param conf pointer to the cache configuration structure
+ *  @param out file to write the trace to, which has to be seekable
+ *
+ */
+void cache_filter_init(struct cache_config_t *conf, FILE *out)
+{
+  struct cache_config_t l1_conf = *conf;
+  l1_conf.l2_index_fn = INDEX_BITS;
+  l1_conf.dram.enabled = FALSE;
+  cache_init(&l1_conf);
+  access_dispatch = filter_access;
+
+  filter_out = out;
+  filter_records = 0;
+  filter_last = 0;
+
+  // the header is filled in by cache_filter_cleanup
+  uint64_t header[FILTER_HEADER_FIELDS] = {};
+  fwrite(FILTER_MAGIC, sizeof(FILTER_MAGIC), 1, filter_out);
+  fwrite(header, sizeof(header), 1, filter_out);
+}
+
+/** @brief Finishes an L1-filtered trace and frees the cache structures
+ *
+ *  Only the access, L1 and VC statistics are meaningful afterwards.
+ *
+ *  @param stats pointer to the cache statistics structure
+ *
+ */
+void cache_filter_cleanup(struct cache_stats_t *stats)
+{
+  uint64_t header[FILTER_HEADER_FIELDS];
+  header[FH_VERSION] = FILTER_VERSION;
+  header[FH_C] = uint64_t(c);
+  header[FH_S] = uint64_t(s);
+  header[FH_B] = uint64_t(b);
+  header[FH_V] = uint64_t(v);
+  header[FH_L1_INDEX] = uint64_t(L1_index_fn);
+  header[FH_RECORDS] = uint64_t(filter_records);
+  header[FH_ACCESSES] = stats->num_accesses;
+  header[FH_READS] = stats->num_accesses_reads;
+  header[FH_WRITES] = stats->num_accesses_writes;
+  header[FH_MISSES_L1] = stats->num_misses_l1;
+  header[FH_MISSES_READS_L1] = stats->num_misses_reads_l1;
+  header[FH_MISSES_WRITES_L1] = stats->num_misses_writes_l1;
+  header[FH_HITS_VC] = stats->num_hits_vc;
+  header[FH_MISSES_VC] = stats->num_misses_vc;
+  header[FH_MISSES_READS_VC] = stats->num_misses_reads_vc;
+  header[FH_MISSES_WRITES_VC] = stats->num_misses_writes_vc;
+
+  fseek(filter_out, long(sizeof(FILTER_MAGIC)), SEEK_SET);
+  fwrite(header, sizeof(header), 1, filter_out);
+
+  // every lookup was counted as an L2 miss
+  stats->num_misses_l2 = 0;
+  stats->num_misses_reads_l2 = 0;
+  stats->num_misses_writes_l2 = 0;
+  cache_cleanup(stats);
+}
+
+/** @brief Reads the header of an L1-filtered trace
+ *
+ *  @param in the filtered trace
+ *  @param conf the configuration to update with the L1 and VC parameters
+ *  @return false if the file is not a filtered trace of this version
+ *
+ */
+bool cache_replay_config(FILE *in, struct cache_config_t *conf)
+{
+  char magic[sizeof(FILTER_MAGIC)];
+  if (fread(magic, sizeof(magic), 1, in) != 1 || memcmp(magic, FILTER_MAGIC, sizeof(magic)) != 0 ||
+      fread(filter_header, sizeof(filter_header), 1, in) != 1 || filter_header[FH_VERSION] != FILTER_VERSION) {
+      return false;
+  }
+  conf->c = filter_header[FH_C];
+  conf->s = filter_header[FH_S];
+  conf->b = filter_header[FH_B];
+  conf->v = filter_header[FH_V];
+  conf->l1_index_fn = filter_header[FH_L1_INDEX];
+  conf->l1_sectors = 1;
+  return true;
+}
+
+// The L2 side of an access that missed L1 and the VC, in the order the
+// access kernel does it. Returns the dirty bit a read fill takes into L1.
+template <class G>
+int64_t replay_lookup(uint64_t addr, char rw, int64_t leave_block, bool leave_dirty, struct cache_stats_t *stats)
+{
+  L2_tag = int64_t((addr >> G::l2_tag_shift())) & L2_tag_mask;
+  L2_index = int64_t((addr >> G::block_bits())) & G::l2_set_mask();
+  if (G::hashed() && L2_index_fn != INDEX_BITS) {
+      L2_tag = int64_t(addr >> G::block_bits()) & vic_tag_mask;
+      L2_index = L2_set_of(L2_tag);
+  }
+
+  // Only the relative order of the counters matters, but the kernel bumps
+  // them on every access, and without that MRU updates keep lowering them
+  if (!G::hashed() || L2_index_fn != INDEX_SKEW) {
+      for (int64_t i = 0; i < G::l2_ways(); i++) {
+          (L2.sets)[L2_index].counter[i]++;
+      }
+  }
+
+  int64_t inherited = 0;
+  int64_t flag = L2_hit<G>(stats);
+
+  if (flag != -1) {
+      int64_t min = 9999999999;
+      for (int64_t i = 0; i < G::l2_ways(); i++) {
+          if ((L2.sets)[L2_index].counter[i] < min && (L2.sets)[L2_index].valid[i] == 1) {
+              min = (L2.sets)[L2_index].counter[i];
+          }
+      }
+      (L2.sets)[L2_index].counter[flag] = L2_mru<G>(L2_index, min); // MRU
+      inherited = rw == 'R' ? (L2.sets)[L2_index].dirty[flag] : 0;
+  } else {
+      stats->num_misses_l2++;
+      if (rw == 'R') {
+          stats->num_misses_reads_l2++;
+      } else {
+          stats->num_misses_writes_l2++;
+      }
+      install_to_L2<G>(0, L2_tag, L2_index, stats);
+  }
+
+  if (leave_block != -1 && leave_dirty) {
+      int64_t Tag, Index;
+      L2_split<G>(leave_block, &Tag, &Index);
+      evict_to_L2<G>(1, Tag, Index, 0, stats);
+  }
+
+  if (flag == -1) {
+      for (int64_t i = 1; i <= k; i++) {
+        uint64_t temp = addr + uint64_t(G::block_size() * i);
+        int64_t Tag, Index;
+        L2_split<G>(int64_t(temp >> G::block_bits()), &Tag, &Index);
+        prefetch<G>(Tag, Index, stats);
+      }
+  }
+  return inherited;
+}
+
+/** @brief Simulates the L2 of an initialized cache over an L1-filtered trace
+ *
+ *  The statistics come out exactly as if the original trace had been run
+ *  through the whole hierarchy.
+ *
+ *  @param in the filtered trace, after cache_replay_config
+ *  @param stats pointer to the cache statistics structure
+ *  @return false if the trace is truncated or corrupt
+ *
+ */
+bool cache_replay(FILE *in, struct cache_stats_t *stats)
+{
+  uint64_t records = filter_header[FH_RECORDS];
+  uint8_t *inherited = new uint8_t[records]; // L2 dirty bit each read fill took into L1
+  bool ok = true;
+
+  for (uint64_t r = 0; r < records && ok; r++) {
+      int flags = getc(in);
+      uint64_t gap, addr, block = 0, back = 0;
+      ok = flags != EOF && get_varint(in, &gap) && fread(&addr, sizeof(addr), 1, in) == 1;
+      if (ok && (flags & FR_LEAVE)) {
+          ok = get_varint(in, &block) && get_varint(in, &back) && back >= 1 && back <= r;
+      }
+      if (ok) {
+          bool leave_dirty = (flags & FR_LEAVE) && ((flags & FR_LEAVE_DIRTY) || inherited[r - back]);
+          skew_clock += int64_t(gap);
+          inherited[r] = uint8_t(replay_lookup<generic_geometry>(addr, (flags & FR_WRITE) ? 'W' : 'R',
+                                                                  (flags & FR_LEAVE) ? int64_t(block) : -1,
+                                                                  leave_dirty, stats));
+          skew_release();
+      }
+  }
+  delete[] inherited;
+
+  stats->num_accesses = filter_header[FH_ACCESSES];
+  stats->num_accesses_reads = filter_header[FH_READS];
+  stats->num_accesses_writes = filter_header[FH_WRITES];
+  stats->num_misses_l1 = filter_header[FH_MISSES_L1];
+  stats->num_misses_reads_l1 = filter_header[FH_MISSES_READS_L1];
+  stats->num_misses_writes_l1 = filter_header[FH_MISSES_WRITES_L1];
+  stats->num_hits_vc = filter_header[FH_HITS_VC];
+  stats->num_misses_vc = filter_header[FH_MISSES_VC];
+  stats->num_misses_reads_vc = filter_header[FH_MISSES_READS_VC];
+  stats->num_misses_writes_vc = filter_header[FH_MISSES_WRITES_VC];
+  return ok;
+}
+
+int64_t largest_prime(int64_t n) {
+	for (int64_t p = n; p > 2; p--) {
+		bool prime = true;
+		for (int64_t d = 2; d * d <= p; d++) {
+			if (p % d == 0) {
+				prime = false;
+				break;
+			}
+		}
+		if (prime) {
+			return p;
+		}
+	}
+	return n < 2 ? n : 2;
+}
+
+// XOR of all set_bits-wide slices of the block number
+int64_t xor_fold(int64_t block, int64_t set_bits) {
+	uint64_t x = uint64_t(block);
+	uint64_t out = 0;
+	if (set_bits == 0) {
+		return 0;
+	}
+	for (; x != 0; x >>= set_bits) {
+		out ^= x & ((uint64_t(1) << set_bits) - 1);
+	}
+	return int64_t(out);
+}
+
+// Per-way hash for skewed associativity: the low bits XORed with a different
+// multiplicative hash of the upper bits in every way
+int64_t skew_hash(int64_t block, int64_t set_bits, int64_t way) {
+	uint64_t mask = (uint64_t(1) << set_bits) - 1;
+	uint64_t hi = (uint64_t(block) >> set_bits) + uint64_t(way);
+	return int64_t((uint64_t(block) ^ ((hi * 0x9E3779B97F4A7C15ULL) >> 32)) & mask);
+}
+
+int64_t hashed_index(int64_t block, int64_t fn, int64_t set_bits, int64_t prime) {
+	if (fn == INDEX_XOR) {
+		return xor_fold(block, set_bits);
+	} else if (fn == INDEX_PRIME) {
+		return int64_t(uint64_t(block) % uint64_t(prime));
+	}
+	return block & ((int64_t(1) << set_bits) - 1);
+}
+
+// Copies way w of set skew_hash(block, w) into way w of the scratch set, with
+// the LRU timestamps turned into ages the counter logic understands
+void L1_gather(int64_t block) {
+	L1_set &t = (L1.sets)[L1_sets];
+	for (int64_t w = 0; w < L1_ways; w++) {
+		L1_set &f = (L1.sets)[skew_hash(block, c - s - b, w)];
+		t.counter[w] = skew_clock - f.counter[w];
+		t.tag[w] = f.tag[w];
+		t.valid[w] = f.valid[w];
+		t.dirty[w] = f.dirty[w];
+		t.sectors[w] = f.sectors[w];
+		t.sector_dirty[w] = f.sector_dirty[w];
+		t.fill[w] = f.fill[w];
+	}
+	L1_gathered = block;
+}
+
+void L1_scatter(int64_t block) {
+	L1_set &f = (L1.sets)[L1_sets];
+	for (int64_t w = 0; w < L1_ways; w++) {
+		L1_set &t = (L1.sets)[skew_hash(block, c - s - b, w)];
+		t.counter[w] = skew_clock - f.counter[w];
+		t.tag[w] = f.tag[w];
+		t.valid[w] = f.valid[w];
+		t.dirty[w] = f.dirty[w];
+		t.sectors[w] = f.sectors[w];
+		t.sector_dirty[w] = f.sector_dirty[w];
+		t.fill[w] = f.fill[w];
+	}
+	L1_gathered = -1;
+}
+
+void L2_gather(int64_t block) {
+	L2_set &t = (L2.sets)[L2_sets];
+	for (int64_t w = 0; w < L2_ways; w++) {
+		L2_set &f = (L2.sets)[skew_hash(block, C - S - b, w)];
+		t.counter[w] = skew_clock - f.counter[w];
+		t.tag[w] = f.tag[w];
+		t.valid[w] = f.valid[w];
+		t.dirty[w] = f.dirty[w];
+		t.prefetch[w] = f.prefetch[w];
+		t.size[w] = f.size[w];
+		t.refs[w] = f.refs[w];
+		t.dead[w] = f.dead[w];
+		t.sectors[w] = f.sectors[w];
+		t.sector_dirty[w] = f.sector_dirty[w];
+	}
+	L2_gathered = block;
+}
+
+void L2_scatter(int64_t block) {
+	L2_set &f = (L2.sets)[L2_sets];
+	for (int64_t w = 0; w < L2_ways; w++) {
+		L2_set &t = (L2.sets)[skew_hash(block, C - S - b, w)];
+		t.counter[w] = skew_clock - f.counter[w];
+		t.tag[w] = f.tag[w];
+		t.valid[w] = f.valid[w];
+		t.dirty[w] = f.dirty[w];
+		t.prefetch[w] = f.prefetch[w];
+		t.size[w] = f.size[w];
+		t.refs[w] = f.refs[w];
+		t.dead[w] = f.dead[w];
+		t.sectors[w] = f.sectors[w];
+		t.sector_dirty[w] = f.sector_dirty[w];
+	}
+	L2_gathered = -1;
+}
+
+// Counter that makes a line the MRU of its set, one below the youngest
+// valid line. The scratch set of a skewed level holds ages of timestamps
+// shared with other sets, so a line touched now gets age 0 there instead.
+template <class G>
+int64_t L1_mru(int64_t index, int64_t min) {
+	return G::hashed() && index == L1_sets ? 0 : min - 1;
+}
+
+template <class G>
+int64_t L2_mru(int64_t index, int64_t min) {
+	return G::hashed() && index == L2_sets ? 0 : min - 1;
+}
+
+void skew_release() {
+	if (L1_gathered != -1) {
+		L1_scatter(L1_gathered);
+	}
+	if (L2_gathered != -1) {
+		L2_scatter(L2_gathered);
+	}
+}
+
+// Set index of a block on a hashed level. Only the current access touches L1,
+// but L2 also sees write backs and prefetches of other blocks; each one takes
+// over the scratch set after the previous block is written back.
+int64_t L1_set_of(int64_t block) {
+	if (L1_index_fn == INDEX_SKEW) {
+		L1_gather(block);
+		return L1_sets;
+	}
+	return hashed_index(block, L1_index_fn, c - s - b, L1_prime);
+}
+
+int64_t L2_set_of(int64_t block) {
+	if (L2_index_fn == INDEX_SKEW) {
+		if (L2_gathered != block) {
+			if (L2_gathered != -1) {
+				L2_scatter(L2_gathered);
+			}
+			L2_gather(block);
+		}
+		return L2_sets;
+	}
+	return hashed_index(block, L2_index_fn, C - S - b, L2_prime);
+}
+
+// Block number of an L1 line
+template <class G>
+int64_t L1_block(int64_t tag, int64_t index) {
+	if (G::hashed() && L1_index_fn != INDEX_BITS) {
+		return tag;
+	}
+	return (tag << G::l1_set_bits()) + index;
+}
+
+// L2 tag and set index of a block number
+template <class G>
+void L2_split(int64_t block, int64_t *tag, int64_t *index) {
+	if (G::hashed() && L2_index_fn != INDEX_BITS) {
+		*tag = block & vic_tag_mask;
+		*index = L2_set_of(*tag);
+		return;
+	}
+	*tag = (block >> G::l2_set_bits()) & L2_tag_mask;
+	*index = block & G::l2_set_mask();
+}
+
+// Block number of an L2 line
+template <class G>
+int64_t L2_block(int64_t tag, int64_t index) {
+	if (G::hashed() && L2_index_fn != INDEX_BITS) {
+		return tag;
+	}
+	return (tag << G::l2_set_bits()) + index;
+}
+
+// Sizes the line just filled into a compressed set and evicts LRU lines
+// until the set's data fits again
+template <class G>
+void compress_fit(int64_t index, int64_t way, struct cache_stats_t *stats) {
+	if (!G::compressed()) {
+		return;
+	}
+	int64_t size = int64_t(compressed_size(uint64_t(L2_compress), uint64_t(L2_block<G>((L2.sets)[index].tag[way], index)),
+	                                       size_t(G::block_size())));
+	(L2.sets)[index].size[way] = size;
+	stats->num_compressed_fills++;
+	stats->num_compressed_bytes += uint64_t(size);
+
+	int64_t used = 0;
+	for (int64_t i = 0; i < G::l2_ways(); i++) {
+		if ((L2.sets)[index].valid[i] == 1) {
+			used += (L2.sets)[index].size[i];
+		}
+	}
+
+	while (used > L2_data_bytes) {
+		int64_t max = -9999999999;
+		int64_t temp = -1;
+		for (int64_t i = 0; i < G::l2_ways(); i++) {
+			if (i != way && (L2.sets)[index].counter[i] > max && (L2.sets)[index].valid[i] == 1) {
+				max = (L2.sets)[index].counter[i];
+				temp = i;
+			}
+		}
+		if ((L2.sets)[index].dirty[temp] == 1) {
+			stats->num_write_backs++;
+			stats->num_bytes_transferred += write_back_units<G>(index, temp);
+			mem_request<G>((L2.sets)[index].tag[temp], index, DRAM_WRITE, stats);
+		}
+		profile_L2_evict<G>(index, temp);
+		event_L2_evict<G>(index, temp);
+		(L2.sets)[index].valid[temp] = 0;
+		used -= (L2.sets)[index].size[temp];
+		stats->num_compaction_evictions++;
+	}
+}
+
+// Looks the current block up in the miss cache and at the head of every
+// stream buffer, and on a hit moves it into L1 the way a VC hit would. A
+// stream buffer hit pops the head and fetches one more block at the tail.
+template <class G>
+bool side_hit(char rw, struct cache_stats_t *stats) {
+	side_clock++;
+	bool hit = false;
+	for (int64_t i = 0; i < mc_entries && !hit; i++) {
+		if (mc.valid[i] == 1 && mc.tag[i] == vic_tag) {
+			stats->num_hits_mc++;
+			mc.counter[i] = side_clock; // MRU, the copy stays
+			hit = true;
+		}
+	}
+	for (int64_t i = 0; i < sb_count && !hit; i++) {
+		stream_buffer &buf = sb[i];
+		if (buf.valid[buf.head] == 1 && buf.tag[buf.head] == vic_tag) {
+			stats->num_hits_sb++;
+			buf.counter = side_clock;
+			stream_fetch<G>(buf, buf.head, stats);
+			buf.head = (buf.head + 1) % sb_depth;
+			hit = true;
+		}
+	}
+	if (!hit) {
+		return false;
+	}
+
+	// the side copies are clean, a dirty line is in the L2 or further out
+	if (v == 0) {
+		install_to_L1_no<G>(rw == 'W' ? 1 : 0, L1_tag, L1_index, stats);
+	} else {
+		install_to_L1<G>(rw == 'W' ? 1 : 0, L1_tag, L1_index, stats);
+	}
+	return true;
+}
+
+// After an L1 miss went to the L2: copies the block into the LRU miss cache
+// entry and restarts the LRU stream buffer at the blocks following it
+template <class G>
+void side_miss(struct cache_stats_t *stats) {
+	if (mc_entries > 0) {
+		int64_t temp = 0;
+		for (int64_t i = 0; i < mc_entries; i++) {
+			if (mc.valid[i] == 0) {
+				temp = i;
+				break;
+			}
+			if (mc.counter[i] < mc.counter[temp]) {
+				temp = i;
+			}
+		}
+		mc.tag[temp] = vic_tag;
+		mc.valid[temp] = 1;
+		mc.counter[temp] = side_clock;
+	}
+
+	if (sb_count > 0) {
+		int64_t temp = 0;
+		for (int64_t i = 1; i < sb_count; i++) {
+			if (sb[i].counter < sb[temp].counter) {
+				temp = i;
+			}
+		}
+		stream_buffer &buf = sb[temp];
+		stats->num_allocations_sb++;
+		buf.head = 0;
+		buf.next = vic_tag + 1;
+		buf.counter = side_clock;
+		for (int64_t j = 0; j < sb_depth; j++) {
+			stream_fetch<G>(buf, j, stats);
+		}
+	}
+}
+
+// Fetches the next block of a stream into one entry. The L2 is probed
+// without being changed; a block it doesn't hold comes from memory and
+// bypasses it.
+template <class G>
+void stream_fetch(stream_buffer &buf, int64_t slot, struct cache_stats_t *stats) {
+	int64_t block = buf.next & vic_tag_mask;
+	buf.next = block + 1;
+	buf.tag[slot] = block;
+	buf.valid[slot] = 1;
+	stats->num_prefetches_sb++;
+
+	int64_t Tag, Index;
+	L2_split<G>(block, &Tag, &Index);
+	for (int64_t i = 0; i < G::l2_ways(); i++) {
+		if ((L2.sets)[Index].tag[i] == Tag && (L2.sets)[Index].valid[i] == 1) {
+			return;
+		}
+	}
+	stats->num_bytes_transferred += fill_units<G>();
+	mem_request<G>(Tag, Index, DRAM_PREFETCH, stats);
+}
+
+// Drops the miss cache and stream buffer copies of a block being written back
+void side_invalidate(int64_t block) {
+	for (int64_t i = 0; i < mc_entries; i++) {
+		if (mc.tag[i] == block) {
+			mc.valid[i] = 0;
+		}
+	}
+	for (int64_t i = 0; i < sb_count; i++) {
+		for (int64_t j = 0; j < sb_depth; j++) {
+			if (sb[i].tag[j] == block) {
+				sb[i].valid[j] = 0;
+			}
+		}
+	}
+}
+
+// Predictor table entry of a block with the given hits since its fill
+int64_t dead_sig(int64_t block, int64_t refs) {
+	uint64_t region = uint64_t(block) >> DEAD_REGION_BITS;
+	uint64_t hits = dead_predictor == DEAD_SIGNATURE ? uint64_t(refs < DEAD_MAX_HITS ? refs : DEAD_MAX_HITS) : 0;
+	return int64_t(((region << 2 | hits) * 0x9E3779B97F4A7C15ULL) >> (64 - DEAD_TABLE_BITS));
+}
+
+bool dead_predict(int64_t block, int64_t refs) {
+	int64_t e = dead_sig(block, refs);
+	if (dead_predictor == DEAD_REFCOUNT) {
+		return dead_conf[e] == 1 && refs >= dead_table[e];
+	}
+	return dead_table[e] >= DEAD_THRESHOLD;
+}
+
+// Runs a demand L2 lookup through the sampler, if its set is sampled, and
+// trains the predictor on the sampled lines that are reused or evicted
+void dead_sample(int64_t block, struct cache_stats_t *stats) {
+	if ((block & ((int64_t(1) << DEAD_SAMPLE_SHIFT) - 1)) != 0) {
+		return;
+	}
+	dead_sampler &set = sampler[(block >> DEAD_SAMPLE_SHIFT) & (dead_sampler_sets - 1)];
+	dead_clock++;
+
+	int64_t way = -1;
+	for (int64_t i = 0; i < dead_sampler_ways; i++) {
+		if (set.valid[i] == 1 && set.tag[i] == block) {
+			way = i;
+		}
+	}
+
+	if (way != -1) { // reused, so the last signature wasn't dead
+		if (set.pred[way] == 1) {
+			stats->num_dead_wrong++;
+		}
+		if (dead_predictor == DEAD_SIGNATURE && dead_table[set.sig[way]] > 0) {
+			dead_table[set.sig[way]]--;
+		}
+		set.refs[way]++;
+	} else {
+		way = 0;
+		for (int64_t i = 0; i < dead_sampler_ways; i++) {
+			if (set.valid[i] == 0) {
+				way = i;
+				break;
+			}
+			if (set.counter[i] < set.counter[way]) {
+				way = i;
+			}
+		}
+		if (set.valid[way] == 1) { // LRU line evicted without another hit
+			stats->num_dead_sampled++;
+			if (set.pred[way] == 1) {
+				stats->num_dead_correct++;
+			}
+			if (dead_predictor == DEAD_SIGNATURE) {
+				if (dead_table[set.sig[way]] < DEAD_COUNTER_MAX) {
+					dead_table[set.sig[way]]++;
+				}
+			} else {
+				int64_t e = dead_sig(set.tag[way], 0);
+				dead_conf[e] = dead_table[e] == set.refs[way] ? 1 : 0;
+				dead_table[e] = set.refs[way];
+			}
+		}
+		set.tag[way] = block;
+		set.valid[way] = 1;
+		set.refs[way] = 0;
+	}
+	set.counter[way] = dead_clock;
+	set.sig[way] = dead_sig(block, set.refs[way]);
+	set.pred[way] = dead_predict(block, set.refs[way]) ? 1 : 0;
+}
+
+// Prediction for a line just filled into the L2
+template <class G>
+void dead_fill(int64_t index, int64_t way) {
+	if (G::dead_blocks()) {
+		(L2.sets)[index].refs[way] = 0;
+		(L2.sets)[index].dead[way] = dead_predict(L2_block<G>((L2.sets)[index].tag[way], index), 0);
+	}
+}
+
+// The least recently used of the lines predicted dead, or the LRU line if
+// none is
+template <class G>
+int64_t dead_victim(int64_t index, int64_t lru, struct cache_stats_t *stats) {
+	int64_t max = -9999999999;
+	int64_t temp = lru;
+	for (int64_t i = 0; i < G::l2_ways(); i++) {
+		if ((L2.sets)[index].dead[i] == 1 && (L2.sets)[index].valid[i] == 1 && (L2.sets)[index].counter[i] > max) {
+			max = (L2.sets)[index].counter[i];
+			temp = i;
+		}
+	}
+	if (temp != lru) {
+		stats->num_dead_victims++;
+	}
+	return temp;
+}
+
+// Profile index of a set; a skewed level's scratch set stands for the set
+// the given way of the gathered block maps to
+int64_t L1_profile_set(int64_t index, int64_t way) {
+	return index == L1_sets ? skew_hash(L1_gathered, c - s - b, way) : index;
+}
+
+int64_t L2_profile_set(int64_t index, int64_t way) {
+	return index == L2_sets ? skew_hash(L2_gathered, C - S - b, way) : index;
+}
+
+template <class G>
+void profile_L1_evict(int64_t index, int64_t way) {
+	if (G::profiled()) {
+		int64_t set = L1_profile_set(index, way);
+		L1_prof.evictions[set]++;
+		L1_prof.dirty_evictions[set] += uint64_t((L1.sets)[index].dirty[way] == 1);
+	}
+}
+
+template <class G>
+void profile_L2_evict(int64_t index, int64_t way) {
+	if (G::profiled()) {
+		int64_t set = L2_profile_set(index, way);
+		L2_prof.evictions[set]++;
+		L2_prof.dirty_evictions[set] += uint64_t((L2.sets)[index].dirty[way] == 1);
+	}
+}
+
+// Events for the observers in cache_events.hpp, before the line is replaced
+template <class G>
+void event_L1_evict(int64_t index, int64_t way) {
+	cache_events::on_evict(LEVEL_L1, uint64_t(L1_block<G>((L1.sets)[index].tag[way], index)),
+	                       (L1.sets)[index].dirty[way] == 1);
+}
+
+template <class G>
+void event_L2_evict(int64_t index, int64_t way) {
+	uint64_t block = uint64_t(L2_block<G>((L2.sets)[index].tag[way], index));
+	bool dirty = (L2.sets)[index].dirty[way] == 1;
+	cache_events::on_evict(LEVEL_L2, block, dirty);
+	if (dirty) {
+		cache_events::on_write_back(LEVEL_L2, block);
+	}
+}
+
+int64_t count_sectors(int64_t mask) {
+	int64_t n = 0;
+	for (; mask != 0; mask &= mask - 1) {
+		n++;
+	}
+	return n;
+}
+
+// Converts a mask of L1 sectors into the mask of L2 sectors covering them
+int64_t L1_to_L2_sectors(int64_t mask) {
+	int64_t out = 0;
+	for (int64_t i = 0; i < L1_sectors; i++) {
+		if ((mask >> i) & 1) {
+			if (L2_sectors >= L1_sectors) {
+				int64_t r = L2_sectors / L1_sectors;
+				out |= ((int64_t(1) << r) - 1) << (i * r);
+			} else {
+				out |= int64_t(1) << (i / (L1_sectors / L2_sectors));
+			}
+		}
+	}
+	return out;
+}
+
+// Sets the sector bits of an L1 line filled for the current access. A partial
+// fill keeps the sectors the line already had.
+template <class G>
+void fill_L1_sectors(int64_t isDirty, int64_t index, int64_t way, bool partial) {
+	if (G::sectored()) {
+		if (!partial) {
+			(L1.sets)[index].sectors[way] = 0;
+			(L1.sets)[index].sector_dirty[way] = 0;
+		}
+		(L1.sets)[index].sectors[way] |= L1_sector_bit | vic_merge_sectors;
+		(L1.sets)[index].sector_dirty[way] |= (isDirty ? L1_sector_bit : 0) | vic_merge_dirty;
+		if ((L1.sets)[index].sector_dirty[way] != 0) {
+			(L1.sets)[index].dirty[way] = 1;
+		}
+	}
+}
+
+// Units of num_bytes_transferred for an L2 fill or write back: one block, or
+// one L2 sector when the L2 is sectored
+template <class G>
+uint64_t fill_units() {
+	return G::sectored() ? uint64_t(count_sectors(L2_sector_mask)) : 1;
+}
+
+template <class G>
+uint64_t write_back_units(int64_t index, int64_t way) {
+	return G::sectored() ? uint64_t(count_sectors((L2.sets)[index].sector_dirty[way])) : 1;
+}
+
+// Sends one block to or from the DRAM model. The address is rebuilt from the
+// L2 tag and set index, so fills and write backs of a block agree on its row.
+template <class G>
+void mem_request(int64_t tag, int64_t index, dram_req_t type, struct cache_stats_t *stats) {
+	if (dram_on) {
+		uint64_t addr = (uint64_t(tag) << G::l2_tag_shift()) | (uint64_t(index) << G::block_bits());
+		if (G::hashed() && L2_index_fn != INDEX_BITS) {
+			addr = uint64_t(tag) << G::block_bits();
+		}
+		dram_access(addr, type, &stats->dram);
+	}
+}
+
+// Gini coefficient of the per-set counts: 0 when every set has the same
+// count, approaching 1 when one set has them all
+static double gini(const uint64_t *x, int64_t n)
+{
+  std::vector<uint64_t> v(x, x + n);
+  std::sort(v.begin(), v.end());
+  double sum = 0, weighted = 0;
+  for (int64_t i = 0; i < n; i++) {
+      sum += double(v[size_t(i)]);
+      weighted += double(i + 1) * double(v[size_t(i)]);
+  }
+  return sum == 0 ? 0 : 2 * weighted / (double(n) * sum) - double(n + 1) / double(n);
+}
+
+static void profile_level(FILE *out, const char *name, const set_profile &p, int64_t sets, uint64_t top_n)
+{
+  uint64_t total = 0;
+  for (int64_t i = 0; i < sets; i++) {
+      total += p.misses[i];
+  }
+  fprintf(out, "\nSET PROFILE %s (%" PRId64 " sets)\n", name, sets);
+  fprintf(out, "Gini of accesses:               %.6f\n", gini(p.accesses, sets));
+  fprintf(out, "Gini of misses:                 %.6f\n", gini(p.misses, sets));
+
+  std::vector<int64_t> order;
+  for (int64_t i = 0; i < sets; i++) {
+      order.push_back(i);
+  }
+  std::stable_sort(order.begin(), order.end(), [&p](int64_t a, int64_t b) { return p.misses[a] > p.misses[b]; });
+  size_t shown = std::min(size_t(top_n), order.size());
+  fprintf(out, "Top %zu sets by misses:\n", shown);
+  fprintf(out, "%10s %12s %12s %10s %12s %12s\n", "set", "accesses", "misses", "share", "evictions", "dirty evict");
+  for (size_t i = 0; i < shown; i++) {
+      int64_t set = order[i];
+      fprintf(out, "%10" PRId64 " %12" PRIu64 " %12" PRIu64 " %10.6f %12" PRIu64 " %12" PRIu64 "\n", set,
+              p.accesses[set], p.misses[set], total ? double(p.misses[set]) / double(total) : 0,
+              p.evictions[set], p.dirty_evictions[set]);
+  }
+
+  // sets by their misses over the mean misses per set
+  static const double edges[] = {0.25, 0.5, 1, 2, 4};
+  static const char *labels[] = {"< 0.25x", "0.25x - 0.5x", "0.5x - 1x", "1x - 2x", "2x - 4x", ">= 4x"};
+  uint64_t hist[6] = {0, 0, 0, 0, 0, 0};
+  double mean = double(total) / double(sets);
+  for (int64_t i = 0; i < sets; i++) {
+      size_t bucket = 0;
+      while (bucket < 5 && mean > 0 && double(p.misses[i]) >= edges[bucket] * mean) {
+          bucket++;
+      }
+      hist[bucket]++;
+  }
+  fprintf(out, "Sets by misses over the mean of %.2f:\n", mean);
+  for (size_t i = 0; i < 6; i++) {
+      fprintf(out, "%14s %10" PRIu64 "\n", labels[i], hist[i]);
+  }
+}
+
+/** @brief Prints the per-set conflict profile; call before cache_cleanup
+ *
+ *  @param out where to print the summary
+ *  @param top_n how many of the sets with the most misses to list
+ *  @param dump where to write every set as CSV, or NULL
+ */
+void cache_profile_report(FILE *out, uint64_t top_n, FILE *dump)
+{
+  if (!profile_on) {
+      return;
+  }
+  const set_profile *profs[] = {&L1_prof, &L2_prof};
+  const int64_t sets[] = {L1_sets, L2_sets};
+  const char *names[] = {"L1", "L2"};
+  if (dump) {
+      fprintf(dump, "level,set,accesses,misses,evictions,dirty_evictions\n");
+  }
+  for (size_t l = 0; l < 2; l++) {
+      uint64_t accesses = 0;
+      for (int64_t i = 0; i < sets[l]; i++) {
+          accesses += profs[l]->accesses[i];
+      }
+      if (accesses == 0) { // L1 of a replay, or an L2 the filter pass left out
+          continue;
+      }
+      profile_level(out, names[l], *profs[l], sets[l], top_n);
+      for (int64_t i = 0; dump && i < sets[l]; i++) {
+          fprintf(dump, "%s,%" PRId64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", names[l], i,
+                  profs[l]->accesses[i], profs[l]->misses[i], profs[l]->evictions[i], profs[l]->dirty_evictions[i]);
+      }
+  }
+}
+
+// Runs one access and records which level serviced it, read off the
+// statistics it changed
+void outcome_access(uint64_t addr, char rw, struct cache_stats_t *stats)
+{
+  uint64_t misses_l1 = stats->num_misses_l1;
+  uint64_t misses_vc = stats->num_misses_vc;
+  uint64_t misses_l2 = stats->num_misses_l2;
+  uint64_t useful = stats->num_useful_prefetches;
+  uint64_t write_backs = stats->num_write_backs;
+  outcome_kernel(addr, rw, stats);
+
+  int record = stats->num_misses_l1 == misses_l1 ? OUTCOME_L1 :
+               stats->num_misses_vc == misses_vc ? OUTCOME_VC :
+               stats->num_misses_l2 == misses_l2 ? OUTCOME_L2 : OUTCOME_MEM;
+  if (stats->num_useful_prefetches != useful) {
+      record |= OUTCOME_USEFUL_PREFETCH;
+  }
+  if (stats->num_write_backs != write_backs) {
+      record |= OUTCOME_WRITE_BACK;
+  }
+  outcome_put(uint8_t(record));
+}
+
+/** @brief Prints the L1 and L2 sets of an address and the VC
+ *
+ *  Same layout as reference_dump_sets, for --diff. Assumes the plain bit
+ *  slice index.
+ *
+ *  @param out where to print
+ *  @param addr the address whose sets are printed
+ */
+void cache_dump_sets(FILE *out, uint64_t addr)
+{
+  int64_t block = int64_t(addr >> b);
+  int64_t l1 = block & (L1_sets - 1);
+  int64_t l2 = block & (L2_sets - 1);
+
+  fprintf(out, "  L1 set %" PRId64 " (way: tag valid dirty counter)\n", l1);
+  for (int64_t i = 0; i < L1_ways; i++) {
+      fprintf(out, "    %" PRId64 ": %" PRIx64 " %" PRId64 " %" PRId64 " %" PRId64 "\n", i, (L1.sets)[l1].tag[i],
+              (L1.sets)[l1].valid[i], (L1.sets)[l1].dirty[i], (L1.sets)[l1].counter[i]);
+  }
+  fprintf(out, "  VC (entry: block valid dirty counter)\n");
+  for (int64_t i = 0; i < v; i++) {
+      fprintf(out, "    %" PRId64 ": %" PRIx64 " %" PRId64 " %" PRId64 " %" PRId64 "\n", i, vic.tag[i], vic.valid[i],
+              vic.dirty[i], vic.counter[i]);
+  }
+  fprintf(out, "  L2 set %" PRId64 " (way: tag valid dirty counter prefetch)\n", l2);
+  for (int64_t i = 0; i < L2_ways; i++) {
+      fprintf(out, "    %" PRId64 ": %" PRIx64 " %" PRId64 " %" PRId64 " %" PRId64 " %" PRId64 "\n", i,
+              (L2.sets)[l2].tag[i], (L2.sets)[l2].valid[i], (L2.sets)[l2].dirty[i], (L2.sets)[l2].counter[i],
+              (L2.sets)[l2].prefetch[i]);
+  }
+}
+
+/** @brief Initializes the cache and starts writing the outcome of every access
+ *
+ *  @param conf pointer to the cache configuration structure
+ *  @param out where to write the outcome stream
+ *  @return false if the stream can't be started
+ */
+bool cache_outcome_init(struct cache_config_t *conf, FILE *out)
+{
+  cache_init(conf);
+  if (!outcome_open(out)) {
+      return false;
+  }
+  outcome_kernel = access_dispatch;
+  access_dispatch = outcome_access;
+  return true;
+}
+
+/** @brief Finalizes statistics like cache_cleanup and finishes the outcome stream
+ *
+ *  @param stats pointer to the cache statistics structure
+ *  @return false if writing the stream failed
+ */
+bool cache_outcome_cleanup(struct cache_stats_t *stats)
+{
+  cache_cleanup(stats);
+  return outcome_close();
 }
 
 /** @brief Function to free any allocated memory and finalize statistics
@@ -678,12 +2436,40 @@ void evict_to_L2(int64_t isDirty, int64_t tag, int64_t index, struct cache_stats
 void cache_cleanup(struct cache_stats_t *stats)
 {
 
-  uint64_t bytes = uint64_t(1 << b);
+  uint64_t bytes = uint64_t(1 << b) / uint64_t(L2_sectors); // one block or one L2 sector
   stats->num_bytes_transferred *= bytes;
 
+  if (dram_on) { // measured memory latency replaces the flat HIT_TIME_MEM
+      dram_cleanup(&stats->dram);
+      if (stats->dram.num_reads > 0) {
+          stats->hit_time_mem = stats->dram.avg_read_latency;
+      }
+  }
+
+  if (compress_on) {
+      uint64_t resident = 0;
+      for (int64_t i = 0; i < L2_sets; i++) {
+          for (int64_t j = 0; j < L2_ways; j++) {
+              resident += uint64_t((L2.sets)[i].valid[j]);
+          }
+      }
+      stats->compression_ratio = stats->num_compressed_bytes ?
+          double(stats->num_compressed_fills << b) / double(stats->num_compressed_bytes) : 0;
+      stats->effective_capacity = double(resident << b) / double(L2_sets * L2_data_bytes);
+  }
+
+  if (dead_on) {
+      uint64_t verified = stats->num_dead_correct + stats->num_dead_wrong;
+      stats->dead_accuracy = verified ? double(stats->num_dead_correct) / double(verified) : 0;
+      stats->dead_coverage = stats->num_dead_sampled ?
+          double(stats->num_dead_correct) / double(stats->num_dead_sampled) : 0;
+  }
+
   stats->miss_rate_l1 = double(stats->num_misses_l1) / double(stats->num_accesses);
 
-  if (v == 0) {
+  // the side structures count as part of the VC, so the VC misses are the
+  // L1 misses that go on to the L2
+  if (v == 0 && !side_on) {
       stats->miss_rate_vc = 1;
       stats->miss_rate_l2 = double(stats->num_misses_l2) / double(stats->num_misses_l1);
       stats->avg_access_time = stats->hit_time_l1 + stats->miss_rate_l1 * (stats->hit_time_l2 + stats->miss_rate_l2 * stats->hit_time_mem);
@@ -693,21 +2479,29 @@ void cache_cleanup(struct cache_stats_t *stats)
       stats->avg_access_time = stats->hit_time_l1 + stats->miss_rate_l1 * stats->miss_rate_vc * (stats->hit_time_l2 + stats->miss_rate_l2 * stats->hit_time_mem);
   }
 
-  for (int64_t i = 0; i < L1_sets; i++) {
+  for (int64_t i = 0; i < L1_sets + (L1_index_fn == INDEX_SKEW ? 1 : 0); i++) {
       delete[] (L1.sets)[i].counter;
       delete[] (L1.sets)[i].tag;
       delete[] (L1.sets)[i].valid;
       delete[] (L1.sets)[i].dirty;
+      delete[] (L1.sets)[i].sectors;
+      delete[] (L1.sets)[i].sector_dirty;
+      delete[] (L1.sets)[i].fill;
   }
 
   delete[] L1.sets;
 
-  for (int64_t i = 0; i < L2_sets; i++) {
+  for (int64_t i = 0; i < L2_sets + (L2_index_fn == INDEX_SKEW ? 1 : 0); i++) {
       delete[] (L2.sets)[i].counter;
       delete[] (L2.sets)[i].tag;
       delete[] (L2.sets)[i].valid;
       delete[] (L2.sets)[i].dirty;
+      delete[] (L2.sets)[i].sectors;
+      delete[] (L2.sets)[i].sector_dirty;
       delete[] (L2.sets)[i].prefetch;
+      delete[] (L2.sets)[i].size;
+      delete[] (L2.sets)[i].refs;
+      delete[] (L2.sets)[i].dead;
   }
 
   delete[] L2.sets;
@@ -716,4 +2510,38 @@ void cache_cleanup(struct cache_stats_t *stats)
   delete[] vic.tag;
   delete[] vic.valid;
   delete[] vic.dirty;
+  delete[] vic.sectors;
+  delete[] vic.sector_dirty;
+  delete[] vic.fill;
+
+  for (int64_t i = 0; i < (dead_on ? dead_sampler_sets : 0); i++) {
+      delete[] sampler[i].counter;
+      delete[] sampler[i].tag;
+      delete[] sampler[i].valid;
+      delete[] sampler[i].refs;
+      delete[] sampler[i].sig;
+      delete[] sampler[i].pred;
+  }
+
+  delete[] sampler;
+  delete[] dead_table;
+  delete[] dead_conf;
+
+  for (set_profile *p : {&L1_prof, &L2_prof}) {
+      delete[] p->accesses;
+      delete[] p->misses;
+      delete[] p->evictions;
+      delete[] p->dirty_evictions;
+  }
+
+  delete[] mc.counter;
+  delete[] mc.tag;
+  delete[] mc.valid;
+
+  for (int64_t i = 0; i < sb_count; i++) {
+      delete[] sb[i].tag;
+      delete[] sb[i].valid;
+  }
+
+  delete[] sb;
 }
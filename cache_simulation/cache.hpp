@@ -11,7 +11,13 @@
 #ifndef CACHE_H
 #define CACHE_H
 
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+
+#include "compress.hpp"
+#include "dram.hpp"
+#include "outcome.hpp"
 
 // Default configuration -- Don't modify
 static const uint64_t DEFAULT_c = 15;
@@ -21,6 +27,27 @@ static const uint64_t DEFAULT_S = 3;
 static const uint64_t DEFAULT_b = 6;
 static const uint64_t DEFAULT_v = 8;
 static const uint64_t DEFAULT_k = 3; // Prefetch stride
+static const uint64_t DEFAULT_SECTORS = 1; // Sectors per block, 1 = not sectored
+static const uint64_t DEFAULT_STREAM_DEPTH = 4; // Blocks per stream buffer
+
+// Bump whenever a change can alter the statistics of an existing configuration,
+// so stale entries in result stores are never reused
+static const uint64_t SIMULATOR_VERSION = 1;
+
+// Set index functions
+enum index_fn_t {
+    INDEX_BITS = 0,     // plain bit slice of the address
+    INDEX_XOR = 1,      // XOR-fold of the block number
+    INDEX_PRIME = 2,    // block number modulo the largest prime <= sets
+    INDEX_SKEW = 3      // skewed associativity, a different hash per way
+};
+
+// Dead-block predictors for L2 bypass and victim selection
+enum dead_pred_t {
+    DEAD_NONE = 0,
+    DEAD_REFCOUNT = 1,  // a line is dead after as many hits as its region's last generation had
+    DEAD_SIGNATURE = 2  // saturating counters indexed by the region and the hits so far
+};
 
 // Constants -- Don't modify
 static const char READ = 'R';
@@ -33,7 +60,7 @@ static const double HIT_TIME_L1_BASE = 2.0;
 static const double HIT_TIME_L2_BASE = 8.0;
 static const double ADJUSTMENT_FACTOR_L1 = 0.2; // Increase in hit time due to set associativity
 static const double ADJUSTMENT_FACTOR_L2 = 0.4;
-static const double HIT_TIME_MEM = 80.0;
+static const double HIT_TIME_MEM = 80.0; // flat memory latency when the DRAM model is off
 
 // Struct for keeping the cache hierarchy parameters
 struct cache_config_t {
@@ -44,10 +71,25 @@ struct cache_config_t {
     uint64_t b; // We assume that both the caches have the exact same block size
     uint64_t v;
     uint64_t k;
+    uint64_t l1_sectors; // sectors per L1 block (power of 2)
+    uint64_t l2_sectors; // sectors per L2 block (power of 2)
+    uint64_t l1_index_fn; // index_fn_t
+    uint64_t l2_index_fn;
+    uint64_t l2_compress; // compress_t
+    uint64_t l2_dead_block; // dead_pred_t
+    uint64_t opt; // also bound the L1/L2 misses with Belady's OPT
+    uint64_t set_profile; // per-set profile listing this many sets, 0 = off
+    uint64_t miss_cache; // blocks in the miss cache, 0 = none
+    uint64_t stream_buffers; // number of stream buffers, 0 = none
+    uint64_t stream_depth; // blocks per stream buffer
+    struct dram_config_t dram;  // optional DRAM back end behind the L2
 
     // Constructor with default values -- Don't modify
     cache_config_t() :  c(DEFAULT_c), C(DEFAULT_C), s(DEFAULT_s), S(DEFAULT_S),
-                        b(DEFAULT_b), v(DEFAULT_v), k(DEFAULT_k) {}
+                        b(DEFAULT_b), v(DEFAULT_v), k(DEFAULT_k),
+                        l1_sectors(DEFAULT_SECTORS), l2_sectors(DEFAULT_SECTORS),
+                        l1_index_fn(INDEX_BITS), l2_index_fn(INDEX_BITS), l2_compress(COMPRESS_NONE), l2_dead_block(DEAD_NONE), opt(FALSE), set_profile(0),
+                        miss_cache(0), stream_buffers(0), stream_depth(DEFAULT_STREAM_DEPTH) {}
 };
 
 // Struct for keeping track of hit-miss statistics
@@ -65,10 +107,18 @@ struct cache_stats_t {
     uint64_t num_misses_reads_vc;           // total read misses in the VC
     uint64_t num_misses_writes_vc;          // total write misses in the VC
 
+    uint64_t num_hits_mc;                   // L1 misses served by the miss cache
+    uint64_t num_hits_sb;                   // L1 misses served by a stream buffer head
+    uint64_t num_allocations_sb;            // stream buffers restarted at a new miss
+    uint64_t num_prefetches_sb;             // blocks fetched into stream buffers
+
     uint64_t num_misses_l2;                 // total misses in just the L2
     uint64_t num_misses_reads_l2;           // total misses in just the L2
     uint64_t num_misses_writes_l2;          // total misses in just the L2
 
+    uint64_t num_sector_misses_l1;          // L1 misses that hit the tag but not the sector
+    uint64_t num_sector_misses_l2;          // L2 misses that hit the tag but not the sector
+
     uint64_t num_write_backs;               // total writebacks
     uint64_t num_bytes_transferred;         // total data transferred on memory bus
 
@@ -83,11 +133,47 @@ struct cache_stats_t {
     double miss_rate_l2;                    // L2 miss rate
     double avg_access_time;                 // average access time per access
 
+    uint64_t num_compressed_fills;          // blocks filled into the compressed L2
+    uint64_t num_compressed_bytes;          // their total compressed size
+    uint64_t num_compaction_evictions;      // extra lines evicted to make room for a fill
+    double compression_ratio;               // uncompressed over compressed bytes of all fills
+    double effective_capacity;              // resident blocks at the end over an uncompressed L2
+    double uncompressed_miss_rate_l2;       // the same L2 without compression, filled in by the driver
+
+    uint64_t num_dead_bypasses;             // L2 demand fills skipped as dead on arrival
+    uint64_t num_dead_victims;              // L2 victims chosen over the LRU line as predicted dead
+    uint64_t num_dead_sampled;              // lines evicted from the predictor's sampler
+    uint64_t num_dead_correct;              // sampled dead predictions the eviction confirmed
+    uint64_t num_dead_wrong;                // sampled dead predictions followed by a hit
+    double dead_accuracy;                   // correct over all verified dead predictions
+    double dead_coverage;                   // correct over all sampled evictions
+    double no_bypass_miss_rate_l2;          // the same L2 without the predictor, filled in by the driver
+    uint64_t no_bypass_bytes_transferred;
+
+    uint64_t num_opt_misses_l1;             // L1 misses under OPT replacement
+    uint64_t num_opt_misses_l2;             // L2 demand misses under OPT, behind an OPT L1
+    double opt_miss_rate_l1;
+    double opt_miss_rate_l2;
+
+    struct dram_stats_t dram;               // DRAM statistics, if the model is enabled
 };
 
 // Visible functions
 void cache_init(struct cache_config_t *conf);
 void cache_access(uint64_t addr, char rw, struct cache_stats_t *stats);
+void cache_access_batch(const uint64_t *addrs, const char *rw, size_t n, struct cache_stats_t *stats);
 void cache_cleanup(struct cache_stats_t *stats);
+void cache_profile_report(FILE *out, uint64_t top_n, FILE *dump);
+void cache_dump_sets(FILE *out, uint64_t addr);
+
+// Outcome stream: which level serviced every access
+bool cache_outcome_init(struct cache_config_t *conf, FILE *out);
+bool cache_outcome_cleanup(struct cache_stats_t *stats);
+
+// L1-filtered traces: simulate L1 and the VC once, then replay only the L2
+void cache_filter_init(struct cache_config_t *conf, FILE *out);
+void cache_filter_cleanup(struct cache_stats_t *stats);
+bool cache_replay_config(FILE *in, struct cache_config_t *conf);
+bool cache_replay(FILE *in, struct cache_stats_t *stats);
 
 #endif // CACHE_H
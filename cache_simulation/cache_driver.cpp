@@ -8,17 +8,28 @@
  * @author Bradley Thwaites
  */
 
+#include <dirent.h>
 #include <getopt.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
 #include <cinttypes>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <string>
-// #include <unistd.h>
+#include <vector>
 
 #include "cache.hpp"
+#include "opt.hpp"
+#include "reference_cache.hpp"
+#include "result_cache.hpp"
+#include "trace_reader.hpp"
 
 static void print_err_usage(std::string err)
 {
@@ -32,9 +43,63 @@ static void print_err_usage(std::string err)
     std::cout << "    -S S     Number of blocks per set in the L2 cache is 2^S" << std::endl;
     std::cout << "    -v v     Number of blocks in the victim cache is v" << std::endl;
     std::cout << "    -k k     Prefetch distance is k" << std::endl;
+    std::cout << "    --l1-sectors N, --l2-sectors N" << std::endl;
+    std::cout << "             Split each L1/L2 block into N sectors with their own valid/dirty bits;" << std::endl;
+    std::cout << "             L2 sectoring needs a sectored L1, since L2 sectors move with the L1 sector that missed" << std::endl;
+    std::cout << "    --l1-index F, --l2-index F" << std::endl;
+    std::cout << "             Set index function: bits (default), xor, prime or skew" << std::endl;
+    std::cout << "    --dram[=ch=N,ra=N,ba=N,row=BYTES,page=open|closed,map=RoRaBaChCo,tCAS=N,tRCD=N,tRP=N,tBURST=N]" << std::endl;
+    std::cout << "             Model DRAM behind the L2 instead of a flat memory latency" << std::endl;
+    std::cout << "    --filter-out F" << std::endl;
+    std::cout << "             Simulate only L1 and the VC and write the L2 traffic to F" << std::endl;
+    std::cout << "    --replay F" << std::endl;
+    std::cout << "             Simulate only the L2 from a trace written by --filter-out (replaces -i)" << std::endl;
+    std::cout << "    --l2-compress bdi|fpc" << std::endl;
+    std::cout << "             Compressed L2 with twice the tags, over synthetic block contents" << std::endl;
+    std::cout << "    --l2-dead-block refcount|signature" << std::endl;
+    std::cout << "             Bypass the L2 and pick victims with a dead-block predictor" << std::endl;
+    std::cout << "    --opt" << std::endl;
+    std::cout << "             Also report the L1/L2 misses under Belady's OPT replacement" << std::endl;
+    std::cout << "    --set-profile[=N], --set-profile-dump F" << std::endl;
+    std::cout << "             Per-set conflict profile listing the N (default 8) worst sets, and every set as CSV to F" << std::endl;
+    std::cout << "    --outcomes F" << std::endl;
+    std::cout << "             Write which level serviced every access to F, 4 bits per access" << std::endl;
+    std::cout << "    --batch DIR|MANIFEST, --batch-out F, --jobs N" << std::endl;
+    std::cout << "             Simulate every trace in DIR or listed in MANIFEST, N at a time (default: all" << std::endl;
+    std::cout << "             cores), and write per-trace and aggregate statistics as CSV to F (default stdout);" << std::endl;
+    std::cout << "             hits_vc_victim_only leaves out miss cache and stream buffer hits" << std::endl;
+    std::cout << "    --miss-cache N" << std::endl;
+    std::cout << "             Miss cache of N blocks, probed with the VC" << std::endl;
+    std::cout << "    --stream-buffers N, --stream-depth D" << std::endl;
+    std::cout << "             N stream buffers of D blocks (default 4), probed with the VC" << std::endl;
+    std::cout << "    --diff" << std::endl;
+    std::cout << "             Run the original engine alongside and stop at the first accesses where they differ" << std::endl;
+    std::cout << "    --parse-threads N" << std::endl;
+    std::cout << "             Parse the trace with N threads (default: up to " << TRACE_MAX_THREADS << ", 1 parses inline)" << std::endl;
+    std::cout << "    --result-cache DIR" << std::endl;
+    std::cout << "             Reuse and store results in DIR, keyed by trace contents and configuration" << std::endl;
     std::exit(EXIT_FAILURE);
 }
 
+static const char *index_fn_names[] = {"bits", "xor", "prime", "skew"};
+
+static uint64_t parse_index_fn(const char *name)
+{
+    for (uint64_t i = 0; i < sizeof(index_fn_names) / sizeof(index_fn_names[0]); i++) {
+        if (strcmp(name, index_fn_names[i]) == 0) {
+            return i;
+        }
+    }
+    print_err_usage("Unknown set index function");
+    return INDEX_BITS;
+}
+
+static const uint64_t DEFAULT_PROFILE_TOP = 8;
+static FILE *profile_dump; // every set of the profile as CSV, if given
+static unsigned parse_threads = trace_default_threads();
+
+static const char *dead_pred_names[] = {"none", "refcount", "signature"};
+
 static void print_config(struct cache_config_t *conf)
 {
     std::cout << "Cache Configuration" << std::endl;
@@ -45,9 +110,36 @@ static void print_config(struct cache_config_t *conf)
     std::cout << "S = " << conf->S << std::endl;
     std::cout << "v = " << conf->v << std::endl;
     std::cout << "k = " << conf->k << std::endl;
+    if (conf->l1_sectors > 1 || conf->l2_sectors > 1) {
+        std::cout << "L1 sectors = " << conf->l1_sectors << std::endl;
+        std::cout << "L2 sectors = " << conf->l2_sectors << std::endl;
+    }
+    if (conf->l1_index_fn != INDEX_BITS || conf->l2_index_fn != INDEX_BITS) {
+        std::cout << "L1 index = " << index_fn_names[conf->l1_index_fn] << std::endl;
+        std::cout << "L2 index = " << index_fn_names[conf->l2_index_fn] << std::endl;
+    }
+    if (conf->l2_compress != COMPRESS_NONE) {
+        std::cout << "L2 compression = " << (conf->l2_compress == COMPRESS_BDI ? "bdi" : "fpc") << std::endl;
+    }
+    if (conf->l2_dead_block != DEAD_NONE) {
+        std::cout << "L2 dead-block predictor = " << dead_pred_names[conf->l2_dead_block] << std::endl;
+    }
+    if (conf->miss_cache > 0) {
+        std::cout << "Miss cache = " << conf->miss_cache << std::endl;
+    }
+    if (conf->stream_buffers > 0) {
+        std::cout << "Stream buffers = " << conf->stream_buffers << " x " << conf->stream_depth << std::endl;
+    }
+    if (conf->dram.enabled) {
+        std::cout << "DRAM = " << conf->dram.channels << "ch x " << conf->dram.ranks << "ra x "
+                  << conf->dram.banks << "ba, " << conf->dram.row_bytes << "B rows, "
+                  << (conf->dram.page_policy == DRAM_OPEN_PAGE ? "open" : "closed") << " page, map "
+                  << conf->dram.map << ", tCAS-tRCD-tRP-tBURST " << conf->dram.tCAS << "-"
+                  << conf->dram.tRCD << "-" << conf->dram.tRP << "-" << conf->dram.tBURST << std::endl;
+    }
 }
 
-static void print_stats(struct cache_stats_t *stats)
+static void print_stats(struct cache_config_t *conf, struct cache_stats_t *stats)
 {
     std::cout << std::fixed; // Make sure that 6 significant digits are always displayed
     std::cout << std::endl << "HIT MISS STATISTICS" << std::endl;
@@ -61,9 +153,21 @@ static void print_stats(struct cache_stats_t *stats)
     std::cout << "Number of VC misses:            " << stats->num_misses_vc << std::endl;
     std::cout << "Number of VC read misses:       " << stats->num_misses_reads_vc << std::endl;
     std::cout << "Number of VC write misses:      " << stats->num_misses_writes_vc << std::endl;
+    if (conf->miss_cache > 0) {
+        std::cout << "Number of miss cache hits:      " << stats->num_hits_mc << std::endl;
+    }
+    if (conf->stream_buffers > 0) {
+        std::cout << "Number of stream buffer hits:   " << stats->num_hits_sb << std::endl;
+        std::cout << "Number of stream allocations:   " << stats->num_allocations_sb << std::endl;
+        std::cout << "Number of stream buffer fetches:" << stats->num_prefetches_sb << std::endl;
+    }
     std::cout << "Number of L2 misses:            " << stats->num_misses_l2 << std::endl;
     std::cout << "Number of L2 read misses:       " << stats->num_misses_reads_l2 << std::endl;
     std::cout << "Number of L2 write misses:      " << stats->num_misses_writes_l2 << std::endl;
+    if (conf->l1_sectors > 1 || conf->l2_sectors > 1) {
+        std::cout << "Number of L1 sector misses:     " << stats->num_sector_misses_l1 << std::endl;
+        std::cout << "Number of L2 sector misses:     " << stats->num_sector_misses_l2 << std::endl;
+    }
     std::cout << "Number of write backs:          " << stats->num_write_backs << std::endl;
     std::cout << "Number of bytes transferred:    " << stats->num_bytes_transferred << std::endl;
     std::cout << "Number of blocks prefetched:    " << stats->num_prefetches << std::endl;
@@ -75,12 +179,446 @@ static void print_stats(struct cache_stats_t *stats)
     std::cout << "VC miss rate:                   " << std::setprecision(6) << stats->miss_rate_vc << std::endl;
     std::cout << "L2 miss rate:                   " << std::setprecision(6) << stats->miss_rate_l2 << std::endl;
     std::cout << "Average Access Time:            " << std::setprecision(6) << stats->avg_access_time << std::endl;
+    if (conf->l2_compress != COMPRESS_NONE) {
+        std::cout << "Number of compressed L2 fills:  " << stats->num_compressed_fills << std::endl;
+        std::cout << "Number of compaction evictions: " << stats->num_compaction_evictions << std::endl;
+        std::cout << "L2 compression ratio:           " << std::setprecision(6) << stats->compression_ratio << std::endl;
+        std::cout << "L2 effective capacity:          " << std::setprecision(6) << stats->effective_capacity << std::endl;
+        std::cout << "Uncompressed L2 miss rate:      " << std::setprecision(6) << stats->uncompressed_miss_rate_l2 << std::endl;
+        std::cout << "L2 miss rate change:            " << std::setprecision(6)
+                  << stats->miss_rate_l2 - stats->uncompressed_miss_rate_l2 << std::endl;
+    }
+    if (conf->l2_dead_block != DEAD_NONE) {
+        std::cout << "Number of dead-block bypasses:  " << stats->num_dead_bypasses << std::endl;
+        std::cout << "Number of dead-block victims:   " << stats->num_dead_victims << std::endl;
+        std::cout << "Dead-block accuracy:            " << std::setprecision(6) << stats->dead_accuracy << std::endl;
+        std::cout << "Dead-block coverage:            " << std::setprecision(6) << stats->dead_coverage << std::endl;
+        std::cout << "L2 miss rate without bypass:    " << std::setprecision(6) << stats->no_bypass_miss_rate_l2 << std::endl;
+        std::cout << "L2 miss rate change:            " << std::setprecision(6)
+                  << stats->miss_rate_l2 - stats->no_bypass_miss_rate_l2 << std::endl;
+        std::cout << "Bytes without bypass:           " << stats->no_bypass_bytes_transferred << std::endl;
+        std::cout << "Bytes transferred change:       "
+                  << int64_t(stats->num_bytes_transferred - stats->no_bypass_bytes_transferred) << std::endl;
+    }
+    if (conf->opt) {
+        std::cout << "Number of OPT L1 misses:        " << stats->num_opt_misses_l1 << std::endl;
+        std::cout << "Number of OPT L2 misses:        " << stats->num_opt_misses_l2 << std::endl;
+        std::cout << "OPT L1 miss rate:               " << std::setprecision(6) << stats->opt_miss_rate_l1 << std::endl;
+        std::cout << "OPT L2 miss rate:               " << std::setprecision(6) << stats->opt_miss_rate_l2 << std::endl;
+    }
+    if (conf->dram.enabled) {
+        std::cout << "Number of DRAM reads:           " << stats->dram.num_reads << std::endl;
+        std::cout << "Number of DRAM prefetch reads:  " << stats->dram.num_prefetch_reads << std::endl;
+        std::cout << "Number of DRAM writes:          " << stats->dram.num_writes << std::endl;
+        std::cout << "Number of row buffer hits:      " << stats->dram.num_row_hits << std::endl;
+        std::cout << "Number of row buffer empties:   " << stats->dram.num_row_empty << std::endl;
+        std::cout << "Number of row buffer conflicts: " << stats->dram.num_row_conflicts << std::endl;
+        std::cout << "Row buffer hit rate:            " << std::setprecision(6) << stats->dram.row_hit_rate << std::endl;
+        std::cout << "Average memory latency:         " << std::setprecision(6) << stats->dram.avg_read_latency << std::endl;
+    }
+}
+
+static void simulate_chunk(const uint64_t *addrs, const char *rws, size_t n, void *stats)
+{
+    cache_access_batch(addrs, rws, n, static_cast<struct cache_stats_t *>(stats));
+}
+
+// Accesses are parsed a chunk at a time and handed to the simulator in
+// order; a malformed line ends the run
+static void run_trace_with(FILE *fin, trace_sink_t sink, void *arg)
+{
+    struct trace_error_t err;
+    if (!trace_read(fin, parse_threads, sink, arg, &err)) {
+        std::cerr << "Trace line " << err.line << ": " << err.message << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+static void run_trace(FILE *fin, struct cache_stats_t *stats)
+{
+    run_trace_with(fin, simulate_chunk, stats);
+}
+
+// Runs a whole trace, or a filtered trace after its header, through a fresh
+// cache, writing the outcome stream if one is given
+static bool simulate(FILE *fin, struct cache_config_t *conf, bool replay, struct cache_stats_t *stats,
+                     FILE *outcomes)
+{
+    if (outcomes == NULL) {
+        cache_init(conf);
+    } else if (!cache_outcome_init(conf, outcomes)) {
+        return false;
+    }
+    if (replay) {
+        if (!cache_replay(fin, stats)) {
+            return false;
+        }
+    } else {
+        run_trace(fin, stats);
+    }
+    if (conf->set_profile > 0) {
+        cache_profile_report(stdout, conf->set_profile, profile_dump);
+    }
+    if (outcomes == NULL) {
+        cache_cleanup(stats);
+    } else if (!cache_outcome_cleanup(stats)) {
+        return false;
+    }
+    return true;
+}
+
+// Runs the input again from start with another configuration, for comparison
+static bool rerun(FILE *fin, long start, struct cache_config_t *conf, bool replay,
+                  const struct cache_stats_t *initial, struct cache_stats_t *stats)
+{
+    if (start < 0 || fseek(fin, start, SEEK_SET) != 0) {
+        return false;
+    }
+    *stats = *initial;
+    conf->set_profile = 0; // the profile is of the configuration asked for
+    return simulate(fin, conf, replay, stats, NULL);
+}
+
+/** @brief simulate(), then the reruns a configuration is compared against
+ *
+ *  A compressed L2 is compared against the same L2 uncompressed, and one
+ *  with a dead-block predictor against the same L2 without it. The reruns
+ *  start over from where fin is now, so they need it seekable; the fields
+ *  they fill in stay 0 otherwise.
+ */
+static bool simulate_compared(FILE *fin, struct cache_config_t *conf, bool replay, struct cache_stats_t *stats,
+                              FILE *outcomes)
+{
+    long start = ftell(fin);
+    struct cache_stats_t initial = *stats;
+    if (!simulate(fin, conf, replay, stats, outcomes)) {
+        return false;
+    }
+
+    struct cache_stats_t base;
+    if (conf->l2_compress != COMPRESS_NONE) {
+        struct cache_config_t plain = *conf;
+        plain.l2_compress = COMPRESS_NONE;
+        if (rerun(fin, start, &plain, replay, &initial, &base)) {
+            stats->uncompressed_miss_rate_l2 = base.miss_rate_l2;
+        }
+    }
+    if (conf->l2_dead_block != DEAD_NONE) {
+        struct cache_config_t plain = *conf;
+        plain.l2_dead_block = DEAD_NONE;
+        if (rerun(fin, start, &plain, replay, &initial, &base)) {
+            stats->no_bypass_miss_rate_l2 = base.miss_rate_l2;
+            stats->no_bypass_bytes_transferred = base.num_bytes_transferred;
+        }
+    }
+    return true;
+}
+
+// The counters the reference engine keeps, compared after every window of accesses
+static const struct {
+    const char *name;
+    uint64_t cache_stats_t::*field;
+} diff_counters[] = {
+    {"num_accesses", &cache_stats_t::num_accesses},
+    {"num_accesses_reads", &cache_stats_t::num_accesses_reads},
+    {"num_accesses_writes", &cache_stats_t::num_accesses_writes},
+    {"num_misses_l1", &cache_stats_t::num_misses_l1},
+    {"num_misses_reads_l1", &cache_stats_t::num_misses_reads_l1},
+    {"num_misses_writes_l1", &cache_stats_t::num_misses_writes_l1},
+    {"num_hits_vc", &cache_stats_t::num_hits_vc},
+    {"num_misses_vc", &cache_stats_t::num_misses_vc},
+    {"num_misses_reads_vc", &cache_stats_t::num_misses_reads_vc},
+    {"num_misses_writes_vc", &cache_stats_t::num_misses_writes_vc},
+    {"num_misses_l2", &cache_stats_t::num_misses_l2},
+    {"num_misses_reads_l2", &cache_stats_t::num_misses_reads_l2},
+    {"num_misses_writes_l2", &cache_stats_t::num_misses_writes_l2},
+    {"num_write_backs", &cache_stats_t::num_write_backs},
+    {"num_bytes_transferred", &cache_stats_t::num_bytes_transferred},
+    {"num_prefetches", &cache_stats_t::num_prefetches},
+    {"num_useful_prefetches", &cache_stats_t::num_useful_prefetches},
+};
+
+struct diff_state {
+    struct cache_stats_t *stats;    // optimized engine
+    struct cache_stats_t *ref;      // reference engine
+};
+
+// Accesses the optimized engine takes per cache_access_batch call under
+// --diff: enough for the batch to prefetch across its own blocks
+static const size_t DIFF_WINDOW = 1024;
+
+// Runs every access through both engines, the optimized one a window at a
+// time through cache_access_batch as a simulation does. The level that
+// serviced an access shows in which counters moved, so comparing all of them
+// after every window also compares the outcomes.
+static void diff_chunk(const uint64_t *addrs, const char *rws, size_t n, void *arg)
+{
+    struct diff_state *d = static_cast<struct diff_state *>(arg);
+    for (size_t base = 0; base < n; base += DIFF_WINDOW) {
+        size_t len = n - base < DIFF_WINDOW ? n - base : DIFF_WINDOW;
+        for (size_t i = base; i < base + len; i++) {
+            reference::cache_access(addrs[i], rws[i], d->ref);
+        }
+        cache_access_batch(addrs + base, rws + base, len, d->stats);
+
+        bool same = true;
+        for (const auto &e : diff_counters) {
+            same = same && d->ref->*e.field == d->stats->*e.field;
+        }
+        if (same) {
+            continue;
+        }
+
+        size_t last = base + len - 1;
+        std::cout << std::endl << "Engines diverge in accesses " << d->ref->num_accesses - len + 1 << " to "
+                  << d->ref->num_accesses << ", the last " << std::hex << addrs[last] << std::dec << " "
+                  << rws[last] << std::endl;
+        for (const auto &e : diff_counters) {
+            if (d->ref->*e.field != d->stats->*e.field) {
+                std::cout << "  " << e.name << ": reference " << d->ref->*e.field << ", optimized "
+                          << d->stats->*e.field << std::endl;
+            }
+        }
+        std::cout << "Reference engine" << std::endl;
+        std::cout.flush();
+        reference::reference_dump_sets(stdout, addrs[last]);
+        printf("Optimized engine\n");
+        cache_dump_sets(stdout, addrs[last]);
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+/** @brief Runs the reference and the optimized engine in lockstep
+ *
+ *  Exits at the first window of DIFF_WINDOW accesses after which any counter
+ *  differs, printing the counters and both engines' L1 set, VC and L2 set for
+ *  the last address of the window.
+ *
+ *  @return true if the final statistics agree too
+ */
+static bool run_diff(FILE *fin, struct cache_config_t *conf, struct cache_stats_t *stats)
+{
+    struct cache_stats_t ref = *stats;
+    struct diff_state d = {stats, &ref};
+    reference::cache_init(conf);
+    cache_init(conf);
+    run_trace_with(fin, diff_chunk, &d);
+    reference::cache_cleanup(&ref);
+    cache_cleanup(stats);
+    fclose(fin);
+
+    bool same = ref.miss_rate_l1 == stats->miss_rate_l1 && ref.miss_rate_vc == stats->miss_rate_vc &&
+                ref.miss_rate_l2 == stats->miss_rate_l2 && ref.avg_access_time == stats->avg_access_time &&
+                ref.num_bytes_transferred == stats->num_bytes_transferred;
+    std::cout << std::endl;
+    if (same) {
+        std::cout << "Engines agree on all " << stats->num_accesses << " accesses" << std::endl;
+    } else {
+        std::cout << "Engines agree after every window but not on the final rates" << std::endl;
+    }
+    return same;
+}
+
+// Traces of a batch: every regular file in a directory, or every line of a
+// manifest that isn't blank or a # comment
+static std::vector<std::string> batch_traces(const char *path)
+{
+    std::vector<std::string> traces;
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(path);
+        if (dir == NULL) {
+            return traces;
+        }
+        for (struct dirent *e; (e = readdir(dir)) != NULL;) {
+            std::string file = std::string(path) + "/" + e->d_name;
+            if (stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                traces.push_back(file);
+            }
+        }
+        closedir(dir);
+        std::sort(traces.begin(), traces.end());
+        return traces;
+    }
+
+    std::ifstream manifest(path);
+    for (std::string line; std::getline(manifest, line);) {
+        line.erase(0, line.find_first_not_of(" \t"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (!line.empty() && line[0] != '#') {
+            traces.push_back(line);
+        }
+    }
+    return traces;
+}
+
+static void batch_row(std::ostream &out, const std::string &name, const struct cache_stats_t &st)
+{
+    out << name << "," << st.num_accesses << "," << st.num_accesses_reads << "," << st.num_accesses_writes << ","
+        << st.num_misses_l1 << "," << st.num_hits_vc << "," << st.num_misses_vc << "," << st.num_misses_l2 << ","
+        << st.num_write_backs << "," << st.num_bytes_transferred << "," << st.num_prefetches << ","
+        << st.num_useful_prefetches << "," << std::setprecision(6) << st.miss_rate_l1 << "," << st.miss_rate_vc
+        << "," << st.miss_rate_l2 << "," << st.avg_access_time << std::endl;
+}
+
+// One trace of a batch, run in a forked worker since the simulator keeps
+// its state in globals. The statistics go back through the pipe.
+static void batch_worker(const std::string &trace, struct cache_config_t *conf, const char *store_dir, int fd)
+{
+    struct cache_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    parse_threads = 1; // the other workers keep the cores busy
+    stats.hit_time_l1 = HIT_TIME_L1_BASE + ADJUSTMENT_FACTOR_L1 * (double) conf->s;
+    stats.hit_time_l2 = HIT_TIME_L2_BASE + ADJUSTMENT_FACTOR_L2 * (double) conf->S;
+    stats.hit_time_mem = HIT_TIME_MEM;
+
+    FILE *fin = fopen(trace.c_str(), "r");
+    if (fin == NULL) {
+        _exit(EXIT_FAILURE);
+    }
+    uint64_t digest = 0;
+    bool stored = store_dir && result_cache_digest(fin, &digest);
+    if (!stored || !result_cache_lookup(store_dir, digest, "trace", conf, &stats)) {
+        simulate_compared(fin, conf, false, &stats, NULL);
+        if (stored) {
+            result_cache_store(store_dir, digest, "trace", conf, &stats);
+        }
+    }
+    fclose(fin);
+
+    ssize_t ret = write(fd, &stats, sizeof(stats));
+    _exit(ret == ssize_t(sizeof(stats)) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/** @brief Simulates one configuration over many traces
+ *
+ *  Traces are handed out largest first to a pool of forked workers, each
+ *  taking the next one as soon as it finishes, so a few large traces don't
+ *  end up last. A worker streams its trace, so memory grows with the number
+ *  of workers and not of traces. The aggregate row sums the counts; its
+ *  rates are over the summed counts, so they weigh every trace by its
+ *  accesses, and so does its AAT.
+ *
+ *  @return the number of traces that failed
+ */
+static int run_batch(const char *path, const char *out_path, long jobs, struct cache_config_t *conf,
+                     const char *store_dir)
+{
+    std::vector<std::string> traces = batch_traces(path);
+    if (traces.empty()) {
+        print_err_usage("No traces in the batch");
+    }
+    std::vector<std::pair<off_t, size_t> > order; // size, position in traces
+    for (size_t i = 0; i < traces.size(); i++) {
+        struct stat st;
+        order.push_back(std::make_pair(stat(traces[i].c_str(), &st) == 0 ? st.st_size : 0, i));
+    }
+    std::stable_sort(order.begin(), order.end(), [](const std::pair<off_t, size_t> &a,
+                                                    const std::pair<off_t, size_t> &b) { return a.first > b.first; });
+
+    std::vector<struct cache_stats_t> results(traces.size());
+    std::vector<bool> ok(traces.size(), false);
+    std::map<pid_t, std::pair<size_t, int> > running; // pid -> trace, pipe
+    size_t next = 0;
+    std::cout.flush();
+
+    while (next < order.size() || !running.empty()) {
+        while (next < order.size() && long(running.size()) < jobs) {
+            size_t t = order[next++].second;
+            int fds[2];
+            if (pipe(fds) != 0) {
+                perror("pipe");
+                std::exit(EXIT_FAILURE);
+            }
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                std::exit(EXIT_FAILURE);
+            }
+            if (pid == 0) {
+                close(fds[0]);
+                batch_worker(traces[t], conf, store_dir, fds[1]);
+            }
+            close(fds[1]);
+            running[pid] = std::make_pair(t, fds[0]);
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+        auto it = running.find(pid);
+        if (it == running.end()) {
+            continue;
+        }
+        size_t t = it->second.first;
+        ssize_t got = read(it->second.second, &results[t], sizeof(results[t]));
+        close(it->second.second);
+        ok[t] = got == ssize_t(sizeof(results[t])) && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+        running.erase(it);
+    }
+
+    std::ofstream file;
+    if (out_path) {
+        file.open(out_path);
+        if (!file) {
+            print_err_usage("Cannot open the batch CSV for writing");
+        }
+    }
+    std::ostream &out = out_path ? file : std::cout;
+    out << std::fixed;
+    // hits_vc counts victim cache hits only; miss cache and stream buffer
+    // hits are in the L1 misses that misses_vc leaves out
+    out << "trace,accesses,reads,writes,misses_l1,hits_vc_victim_only,misses_vc,misses_l2,write_backs,bytes_transferred,"
+        << "prefetches,useful_prefetches,miss_rate_l1,miss_rate_vc,miss_rate_l2,avg_access_time" << std::endl;
+
+    struct cache_stats_t all;
+    memset(&all, 0, sizeof(all));
+    double weighted_aat = 0;
+    int failed = 0;
+    for (size_t t = 0; t < traces.size(); t++) {
+        if (!ok[t]) {
+            std::cerr << "Cannot simulate " << traces[t] << std::endl;
+            failed++;
+            continue;
+        }
+        const struct cache_stats_t &st = results[t];
+        batch_row(out, traces[t], st);
+        all.num_accesses += st.num_accesses;
+        all.num_accesses_reads += st.num_accesses_reads;
+        all.num_accesses_writes += st.num_accesses_writes;
+        all.num_misses_l1 += st.num_misses_l1;
+        all.num_hits_vc += st.num_hits_vc;
+        all.num_misses_vc += st.num_misses_vc;
+        all.num_misses_l2 += st.num_misses_l2;
+        all.num_write_backs += st.num_write_backs;
+        all.num_bytes_transferred += st.num_bytes_transferred;
+        all.num_prefetches += st.num_prefetches;
+        all.num_useful_prefetches += st.num_useful_prefetches;
+        weighted_aat += st.avg_access_time * double(st.num_accesses);
+    }
+    if (all.num_accesses > 0) {
+        // as in cache_cleanup, the side structures count as part of the VC
+        bool vc_on = conf->v != 0 || conf->miss_cache != 0 || conf->stream_buffers != 0;
+        all.miss_rate_l1 = double(all.num_misses_l1) / double(all.num_accesses);
+        all.miss_rate_vc = vc_on ? double(all.num_misses_vc) / double(all.num_misses_l1) : 1;
+        all.miss_rate_l2 = double(all.num_misses_l2) / double(vc_on ? all.num_misses_vc : all.num_misses_l1);
+        all.avg_access_time = weighted_aat / double(all.num_accesses);
+    }
+    batch_row(out, "ALL", all);
+    return failed;
 }
 
 int main(int argc, char *const argv[])
 {
     int opt;
     FILE *fin = stdin;
+    const char *filter_path = NULL;
+    const char *replay_path = NULL;
+    const char *store_dir = NULL;
+    FILE *outcomes = NULL;
+    const char *batch_path = NULL;
+    bool diff = false;
+    const char *batch_out = NULL;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
 
     struct cache_config_t DEFAULT_CONF;
 
@@ -88,8 +626,131 @@ int main(int argc, char *const argv[])
         print_err_usage("Input file argument not provided");
     }
 
-    while (-1 != (opt = getopt(argc, argv, "c:C:b:B:s:S:i:I:v:V:k:K:h"))) {
+    // Long options have no short form and are identified by their flag value
+    enum { OPT_DRAM = 256, OPT_L1_SECTORS, OPT_L2_SECTORS, OPT_L1_INDEX, OPT_L2_INDEX, OPT_FILTER_OUT, OPT_REPLAY, OPT_RESULT_CACHE, OPT_L2_COMPRESS,
+           OPT_L2_DEAD_BLOCK, OPT_OPT, OPT_SET_PROFILE, OPT_SET_PROFILE_DUMP, OPT_OUTCOMES,
+           OPT_BATCH, OPT_BATCH_OUT, OPT_JOBS, OPT_MISS_CACHE, OPT_STREAM_BUFFERS, OPT_STREAM_DEPTH,
+           OPT_PARSE_THREADS, OPT_DIFF };
+    static const struct option long_opts[] = {
+        {"dram", optional_argument, NULL, OPT_DRAM},
+        {"l1-sectors", required_argument, NULL, OPT_L1_SECTORS},
+        {"l2-sectors", required_argument, NULL, OPT_L2_SECTORS},
+        {"l1-index", required_argument, NULL, OPT_L1_INDEX},
+        {"l2-index", required_argument, NULL, OPT_L2_INDEX},
+        {"filter-out", required_argument, NULL, OPT_FILTER_OUT},
+        {"replay", required_argument, NULL, OPT_REPLAY},
+        {"result-cache", required_argument, NULL, OPT_RESULT_CACHE},
+        {"l2-compress", required_argument, NULL, OPT_L2_COMPRESS},
+        {"l2-dead-block", required_argument, NULL, OPT_L2_DEAD_BLOCK},
+        {"opt", no_argument, NULL, OPT_OPT},
+        {"set-profile", optional_argument, NULL, OPT_SET_PROFILE},
+        {"set-profile-dump", required_argument, NULL, OPT_SET_PROFILE_DUMP},
+        {"outcomes", required_argument, NULL, OPT_OUTCOMES},
+        {"batch", required_argument, NULL, OPT_BATCH},
+        {"batch-out", required_argument, NULL, OPT_BATCH_OUT},
+        {"jobs", required_argument, NULL, OPT_JOBS},
+        {"parse-threads", required_argument, NULL, OPT_PARSE_THREADS},
+        {"diff", no_argument, NULL, OPT_DIFF},
+        {"miss-cache", required_argument, NULL, OPT_MISS_CACHE},
+        {"stream-buffers", required_argument, NULL, OPT_STREAM_BUFFERS},
+        {"stream-depth", required_argument, NULL, OPT_STREAM_DEPTH},
+        {NULL, 0, NULL, 0}
+    };
+
+    while (-1 != (opt = getopt_long(argc, argv, "c:C:b:B:s:S:i:I:v:V:k:K:h", long_opts, NULL))) {
         switch (opt) {
+            case OPT_DRAM:
+                if (!dram_parse_config(optarg ? optarg : "", &DEFAULT_CONF.dram)) {
+                    print_err_usage("Invalid DRAM description");
+                }
+                break;
+            case OPT_L1_SECTORS:
+                DEFAULT_CONF.l1_sectors = (uint64_t) atoi(optarg);
+                break;
+            case OPT_L2_SECTORS:
+                DEFAULT_CONF.l2_sectors = (uint64_t) atoi(optarg);
+                break;
+            case OPT_L1_INDEX:
+                DEFAULT_CONF.l1_index_fn = parse_index_fn(optarg);
+                break;
+            case OPT_L2_INDEX:
+                DEFAULT_CONF.l2_index_fn = parse_index_fn(optarg);
+                break;
+            case OPT_FILTER_OUT:
+                filter_path = optarg;
+                break;
+            case OPT_REPLAY:
+                replay_path = optarg;
+                break;
+            case OPT_RESULT_CACHE:
+                store_dir = optarg;
+                break;
+            case OPT_L2_COMPRESS:
+                if (strcmp(optarg, "bdi") == 0) {
+                    DEFAULT_CONF.l2_compress = COMPRESS_BDI;
+                } else if (strcmp(optarg, "fpc") == 0) {
+                    DEFAULT_CONF.l2_compress = COMPRESS_FPC;
+                } else {
+                    print_err_usage("Unknown compression algorithm");
+                }
+                break;
+            case OPT_L2_DEAD_BLOCK:
+                if (strcmp(optarg, "refcount") == 0) {
+                    DEFAULT_CONF.l2_dead_block = DEAD_REFCOUNT;
+                } else if (strcmp(optarg, "signature") == 0) {
+                    DEFAULT_CONF.l2_dead_block = DEAD_SIGNATURE;
+                } else {
+                    print_err_usage("Unknown dead-block predictor");
+                }
+                break;
+            case OPT_OPT:
+                DEFAULT_CONF.opt = TRUE;
+                break;
+            case OPT_SET_PROFILE:
+                DEFAULT_CONF.set_profile = optarg ? (uint64_t) atoi(optarg) : DEFAULT_PROFILE_TOP;
+                if (DEFAULT_CONF.set_profile == 0) {
+                    print_err_usage("The set profile lists at least one set");
+                }
+                break;
+            case OPT_SET_PROFILE_DUMP:
+                profile_dump = fopen(optarg, "w");
+                if (profile_dump == NULL) {
+                    print_err_usage("Cannot open the set profile dump for writing");
+                }
+                if (DEFAULT_CONF.set_profile == 0) {
+                    DEFAULT_CONF.set_profile = DEFAULT_PROFILE_TOP;
+                }
+                break;
+            case OPT_OUTCOMES:
+                outcomes = fopen(optarg, "wb");
+                if (outcomes == NULL) {
+                    print_err_usage("Cannot open the outcome stream for writing");
+                }
+                break;
+            case OPT_BATCH:
+                batch_path = optarg;
+                break;
+            case OPT_BATCH_OUT:
+                batch_out = optarg;
+                break;
+            case OPT_DIFF:
+                diff = true;
+                break;
+            case OPT_PARSE_THREADS:
+                parse_threads = unsigned(atoi(optarg));
+                break;
+            case OPT_JOBS:
+                jobs = atol(optarg);
+                break;
+            case OPT_MISS_CACHE:
+                DEFAULT_CONF.miss_cache = (uint64_t) atoi(optarg);
+                break;
+            case OPT_STREAM_BUFFERS:
+                DEFAULT_CONF.stream_buffers = (uint64_t) atoi(optarg);
+                break;
+            case OPT_STREAM_DEPTH:
+                DEFAULT_CONF.stream_depth = (uint64_t) atoi(optarg);
+                break;
             case 'c':
                 DEFAULT_CONF.c = (uint64_t) atoi(optarg);
                 break;
@@ -125,8 +786,77 @@ int main(int argc, char *const argv[])
         }
     }
 
+    for (uint64_t n : {DEFAULT_CONF.l1_sectors, DEFAULT_CONF.l2_sectors}) {
+        if (n == 0 || (n & (n - 1)) != 0 || n > 32 || n > (uint64_t(1) << DEFAULT_CONF.b)) {
+            print_err_usage("Sectors per block must be a power of 2, at most 32 and at most the block size");
+        }
+    }
+
+    // L2 sectors are tracked through the L1 sector that missed, so with whole
+    // L1 lines every L2 fill and write back would be a whole line too
+    if (DEFAULT_CONF.l2_sectors > 1 && DEFAULT_CONF.l1_sectors == 1) {
+        print_err_usage("--l2-sectors only takes effect with a sectored L1 (--l1-sectors)");
+    }
+    if ((filter_path || replay_path) && (DEFAULT_CONF.l1_sectors > 1 || DEFAULT_CONF.l2_sectors > 1)) {
+        print_err_usage("Filtered traces don't support sectored caches");
+    }
+    if (DEFAULT_CONF.l2_compress != COMPRESS_NONE &&
+        (DEFAULT_CONF.l2_sectors > 1 || DEFAULT_CONF.l2_index_fn == INDEX_SKEW || DEFAULT_CONF.b < 3)) {
+        print_err_usage("A compressed L2 can't be sectored or skewed, and needs blocks of at least 8 bytes");
+    }
+    bool side = DEFAULT_CONF.miss_cache > 0 || DEFAULT_CONF.stream_buffers > 0;
+    if (side && (filter_path || replay_path || DEFAULT_CONF.l1_sectors > 1 || DEFAULT_CONF.l2_sectors > 1)) {
+        print_err_usage("Miss caches and stream buffers don't support filtered traces or sectored caches");
+    }
+    if (DEFAULT_CONF.opt && (filter_path || replay_path)) {
+        print_err_usage("OPT needs the full trace, not a filtered one");
+    }
+    // OPT reads the trace a second time, so find out now rather than after
+    // the whole LRU simulation
+    if (DEFAULT_CONF.opt && (ftell(fin) < 0 || fseek(fin, 0, SEEK_CUR) != 0)) {
+        print_err_usage("OPT needs a seekable, non-empty trace");
+    }
+    if (DEFAULT_CONF.set_profile > 0 && filter_path) {
+        print_err_usage("The set profile needs a full or replayed simulation");
+    }
+    if (outcomes && (filter_path || replay_path)) {
+        print_err_usage("The outcome stream needs a full simulation");
+    }
+    if (batch_path && (filter_path || replay_path || outcomes || DEFAULT_CONF.opt || DEFAULT_CONF.set_profile > 0)) {
+        print_err_usage("A batch can't be combined with filtered traces, OPT, set profiles or outcome streams");
+    }
+    if (diff && (filter_path || replay_path || batch_path || outcomes || DEFAULT_CONF.opt ||
+                 DEFAULT_CONF.set_profile > 0 || DEFAULT_CONF.l1_sectors > 1 || DEFAULT_CONF.l2_sectors > 1 ||
+                 DEFAULT_CONF.l1_index_fn != INDEX_BITS || DEFAULT_CONF.l2_index_fn != INDEX_BITS ||
+                 DEFAULT_CONF.dram.enabled || DEFAULT_CONF.l2_compress != COMPRESS_NONE ||
+                 DEFAULT_CONF.l2_dead_block != DEAD_NONE || side)) {
+        print_err_usage("--diff compares the original c/s/C/S/b/v/k hierarchy only");
+    }
+    if (jobs < 1) {
+        print_err_usage("Need at least one job");
+    }
+    if (DEFAULT_CONF.stream_depth == 0) {
+        print_err_usage("Stream buffers need at least one entry");
+    }
+    if (filter_path && replay_path) {
+        print_err_usage("--filter-out and --replay are exclusive");
+    }
+
+    // A filtered trace fixes the L1 and VC parameters
+    if (replay_path) {
+        fin = fopen(replay_path, "rb");
+        if (fin == NULL || !cache_replay_config(fin, &DEFAULT_CONF)) {
+            print_err_usage("Cannot read filtered trace");
+        }
+    }
+
     print_config(&DEFAULT_CONF);
 
+    if (batch_path) {
+        std::cout << std::endl;
+        return run_batch(batch_path, batch_out, jobs, &DEFAULT_CONF, store_dir) == 0 ? 0 : EXIT_FAILURE;
+    }
+
     // stats struct being used by the driver
     struct cache_stats_t stats;
     memset(&stats, 0, sizeof(struct cache_stats_t));
@@ -136,24 +866,64 @@ int main(int argc, char *const argv[])
     stats.hit_time_l2 = HIT_TIME_L2_BASE + ADJUSTMENT_FACTOR_L2 * (double) DEFAULT_CONF.S;
     stats.hit_time_mem = HIT_TIME_MEM;
 
-    // Call the init function only once
-    cache_init(&DEFAULT_CONF);
+    if (diff) {
+        if (fin == NULL) {
+            print_err_usage("Input file argument not provided");
+        }
+        bool same = run_diff(fin, &DEFAULT_CONF, &stats);
+        print_stats(&DEFAULT_CONF, &stats);
+        return same ? 0 : EXIT_FAILURE;
+    }
+
+    // Results are only stored for seekable inputs, since the digest needs a
+    // pass over the whole file before the simulation, and without a set
+    // profile or outcome stream, which are written as they are gathered
+    const char *mode = replay_path ? "replay" : "trace";
+    uint64_t digest = 0;
+    if (filter_path || fin == NULL || DEFAULT_CONF.set_profile > 0 || outcomes ||
+        !result_cache_digest(fin, &digest)) {
+        store_dir = NULL;
+    }
+    if (store_dir && result_cache_lookup(store_dir, digest, mode, &DEFAULT_CONF, &stats)) {
+        fclose(fin);
+        print_stats(&DEFAULT_CONF, &stats);
+        return 0;
+    }
 
-    char rw;
-    uint64_t addr;
-    while (!feof(fin)) {
-        // Don't change this line if you want this to work!
-        int ret = fscanf(fin, "%" PRIx64 " %c\n", &addr, &rw);
-        if (ret == 2) {
-            // Perform accesses -- one at a time
-            cache_access(addr, rw, &stats);
+    if (filter_path) {
+        FILE *fout = fopen(filter_path, "wb");
+        if (fout == NULL) {
+            print_err_usage("Cannot open filtered trace for writing");
         }
+        cache_filter_init(&DEFAULT_CONF, fout);
+        run_trace(fin, &stats);
+        fclose(fin);
+        cache_filter_cleanup(&stats);
+        fclose(fout);
+        std::cout << std::endl << "Wrote " << stats.num_misses_vc << " L2 lookups for " << stats.num_accesses
+                  << " accesses to " << filter_path << std::endl;
+        return 0;
+    }
+
+    long start = ftell(fin);
+    if (!simulate_compared(fin, &DEFAULT_CONF, replay_path != NULL, &stats, outcomes)) {
+        print_err_usage(outcomes ? "Cannot write the outcome stream" : "Truncated or corrupt filtered trace");
+    }
+    if (outcomes) {
+        fclose(outcomes);
+    }
+    if (DEFAULT_CONF.opt && (start < 0 || fseek(fin, start, SEEK_SET) != 0 || !opt_run(fin, &DEFAULT_CONF, &stats))) {
+        print_err_usage("OPT needs a seekable, non-empty trace");
     }
     fclose(fin);
 
-    // Cleanup memory and perform any computations you might need to then print statistics
-    cache_cleanup(&stats);
-    print_stats(&stats);
+    if (store_dir) {
+        result_cache_store(store_dir, digest, mode, &DEFAULT_CONF, &stats);
+    }
+    print_stats(&DEFAULT_CONF, &stats);
+    if (profile_dump) {
+        fclose(profile_dump);
+    }
 
     return 0;
 }
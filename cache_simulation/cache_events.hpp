@@ -0,0 +1,99 @@
+/**
+ * @file cache_events.hpp
+ * @brief Compile-time observers of hierarchy events
+ *
+ * The access kernels report every hit, miss, fill, eviction and write back
+ * at L1, the VC and the L2, and every prefetch issued and first used, to
+ * cache_events. That is a list of observer types fixed at build time whose
+ * static functions are called directly, so with the default empty list all
+ * of it inlines away and the kernels are unchanged.
+ *
+ * An observer is a struct deriving from null_observer that hides the
+ * functions it cares about, e.g.
+ *
+ *     struct reuse_observer : null_observer {
+ *         static void on_hit(cache_level_t level, uint64_t block) { ... }
+ *     };
+ *
+ * built in with -DCACHE_OBSERVER_HEADER='"reuse_observer.hpp"'
+ * -DCACHE_OBSERVERS=reuse_observer. Blocks are block numbers (address >> b),
+ * truncated the way the VC tags are.
+ */
+
+#ifndef CACHE_EVENTS_H
+#define CACHE_EVENTS_H
+
+#include <cstdint>
+
+enum cache_level_t {
+    LEVEL_L1 = 0,
+    LEVEL_VC = 1,
+    LEVEL_L2 = 2
+};
+
+struct null_observer {
+    static void on_hit(cache_level_t, uint64_t) {}
+    static void on_miss(cache_level_t, uint64_t) {}
+    static void on_fill(cache_level_t, uint64_t) {}
+    static void on_evict(cache_level_t, uint64_t, bool) {}     // dirty or not
+    static void on_write_back(cache_level_t, uint64_t) {}      // to the level below
+    static void on_prefetch_issue(cache_level_t, uint64_t) {}
+    static void on_prefetch_use(cache_level_t, uint64_t) {}
+};
+
+template <class... Observers> struct observer_list;
+
+template <> struct observer_list<> : null_observer {};
+
+template <class O, class... Rest>
+struct observer_list<O, Rest...> {
+    typedef observer_list<Rest...> rest;
+
+    static void on_hit(cache_level_t l, uint64_t block)
+    {
+        O::on_hit(l, block);
+        rest::on_hit(l, block);
+    }
+    static void on_miss(cache_level_t l, uint64_t block)
+    {
+        O::on_miss(l, block);
+        rest::on_miss(l, block);
+    }
+    static void on_fill(cache_level_t l, uint64_t block)
+    {
+        O::on_fill(l, block);
+        rest::on_fill(l, block);
+    }
+    static void on_evict(cache_level_t l, uint64_t block, bool dirty)
+    {
+        O::on_evict(l, block, dirty);
+        rest::on_evict(l, block, dirty);
+    }
+    static void on_write_back(cache_level_t l, uint64_t block)
+    {
+        O::on_write_back(l, block);
+        rest::on_write_back(l, block);
+    }
+    static void on_prefetch_issue(cache_level_t l, uint64_t block)
+    {
+        O::on_prefetch_issue(l, block);
+        rest::on_prefetch_issue(l, block);
+    }
+    static void on_prefetch_use(cache_level_t l, uint64_t block)
+    {
+        O::on_prefetch_use(l, block);
+        rest::on_prefetch_use(l, block);
+    }
+};
+
+#ifdef CACHE_OBSERVER_HEADER
+#include CACHE_OBSERVER_HEADER
+#endif
+
+#ifndef CACHE_OBSERVERS
+#define CACHE_OBSERVERS
+#endif
+
+typedef observer_list<CACHE_OBSERVERS> cache_events;
+
+#endif // CACHE_EVENTS_H
@@ -0,0 +1,192 @@
+#include <cstring>
+
+#include "compress.hpp"
+
+static const size_t MAX_BLOCK = 1 << 12;
+
+static uint64_t mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static int64_t load(const uint8_t *p, size_t width)
+{
+    uint64_t x = 0;
+    memcpy(&x, p, width);
+    if (width < 8 && (x >> (8 * width - 1)) & 1) { // sign extend
+        x |= ~uint64_t(0) << (8 * width);
+    }
+    return int64_t(x);
+}
+
+static bool fits(int64_t x, size_t bytes)
+{
+    int64_t lim = int64_t(1) << (8 * bytes - 1);
+    return x >= -lim && x < lim;
+}
+
+/** @brief Fills a block with synthetic contents
+ *
+ *  Out of every 20 blocks about 4 are zero, 2 repeat one value, 5 hold
+ *  narrow integers, 5 hold pointers near a common base and 4 are random.
+ *
+ *  @param block the block number, which seeds the contents
+ *  @param data where to write the contents
+ *  @param n the block size in bytes, a multiple of 8
+ */
+void compress_synthetic_block(uint64_t block, uint8_t *data, size_t n)
+{
+    uint64_t h = mix(block + 0x9E3779B97F4A7C15ULL);
+    uint64_t kind = h % 20;
+    uint64_t base = 0x00007F0000000000ULL + ((h >> 8) & 0xFFFFFF) * 64;
+
+    for (size_t i = 0; i < n; i += 8) {
+        uint64_t r = mix(h + i);
+        uint64_t w;
+        if (kind < 4) {
+            w = 0;
+        } else if (kind < 6) {
+            w = h;
+        } else if (kind < 11) { // two 32-bit integers in -128..127
+            uint32_t lo = uint32_t(int32_t(int8_t(r & 0xFF)));
+            uint32_t hi = uint32_t(int32_t(int8_t((r >> 8) & 0xFF)));
+            w = uint64_t(lo) | (uint64_t(hi) << 32);
+        } else if (kind < 16) { // pointers within 64 KB of a base, some NULL
+            w = (r & 7) == 0 ? 0 : base + (r & 0xFFFF);
+        } else {
+            w = r;
+        }
+        memcpy(data + i, &w, sizeof(w));
+    }
+}
+
+// Size of the block as one base of the given width plus deltas, where every
+// element is a small delta from either the base or zero (the implicit second
+// base), or 0 if some element fits neither
+static uint64_t bdi_size(const uint8_t *data, size_t n, size_t width, size_t delta)
+{
+    bool have_base = false;
+    int64_t base = 0;
+    for (size_t i = 0; i < n; i += width) {
+        int64_t x = load(data + i, width);
+        if (fits(x, delta)) {
+            continue;
+        }
+        if (!have_base) {
+            have_base = true;
+            base = x;
+        }
+        if (!fits(int64_t(uint64_t(x) - uint64_t(base)), delta)) {
+            return 0;
+        }
+    }
+    // base, one delta per element and a bit per element saying which base
+    return width + (n / width) * delta + (n / width + 7) / 8;
+}
+
+/** @brief Compressed size of a block under Base-Delta-Immediate
+ *
+ *  @param data the block contents
+ *  @param n the block size in bytes, a multiple of 8
+ *  @return the size in bytes, n if the block doesn't compress
+ */
+uint64_t compress_bdi(const uint8_t *data, size_t n)
+{
+    static const size_t encodings[][2] = {{8, 1}, {4, 1}, {8, 2}, {2, 1}, {4, 2}, {8, 4}};
+    bool zero = true;
+    bool repeated = true;
+    for (size_t i = 0; i < n; i++) {
+        zero = zero && data[i] == 0;
+        repeated = repeated && data[i] == data[i % 8];
+    }
+    if (zero) {
+        return 1;
+    }
+    if (repeated) {
+        return 8;
+    }
+
+    uint64_t best = n;
+    for (const auto &e : encodings) {
+        uint64_t size = bdi_size(data, n, e[0], e[1]);
+        if (size != 0 && size < best) {
+            best = size;
+        }
+    }
+    return best;
+}
+
+/** @brief Compressed size of a block under Frequent Pattern Compression
+ *
+ *  Every 32-bit word gets a 3-bit prefix and is stored as a run of zero
+ *  words, a sign-extended 4, 8 or 16 bit value, a halfword padded with
+ *  zeros, two sign-extended bytes, a repeated byte or uncompressed.
+ *
+ *  @param data the block contents
+ *  @param n the block size in bytes, a multiple of 8
+ *  @return the size in bytes, n if the block doesn't compress
+ */
+uint64_t compress_fpc(const uint8_t *data, size_t n)
+{
+    uint64_t bits = 0;
+    size_t words = n / 4;
+    for (size_t i = 0; i < words;) {
+        int64_t x = load(data + 4 * i, 4);
+        uint32_t u = uint32_t(x);
+        bits += 3;
+
+        if (u == 0) { // zero run of up to 8 words
+            size_t run = 1;
+            while (run < 8 && i + run < words && load(data + 4 * (i + run), 4) == 0) {
+                run++;
+            }
+            bits += 3;
+            i += run;
+            continue;
+        }
+
+        int16_t hi = int16_t(u >> 16);
+        int16_t lo = int16_t(u & 0xFFFF);
+        uint8_t b0 = uint8_t(u);
+        if (x >= -8 && x < 8) {
+            bits += 4;
+        } else if (fits(x, 1)) {
+            bits += 8;
+        } else if (fits(x, 2)) {
+            bits += 16;
+        } else if ((u & 0xFFFF) == 0) {
+            bits += 16;
+        } else if (hi >= -128 && hi < 128 && lo >= -128 && lo < 128) {
+            bits += 16;
+        } else if (u == b0 * 0x01010101U) {
+            bits += 8;
+        } else {
+            bits += 32;
+        }
+        i++;
+    }
+    uint64_t bytes = (bits + 7) / 8;
+    return bytes < n ? bytes : n;
+}
+
+/** @brief Stored size of a block, rounded up to whole segments
+ *
+ *  @param algo the compress_t algorithm
+ *  @param block the block number
+ *  @param n the block size in bytes
+ */
+uint64_t compressed_size(uint64_t algo, uint64_t block, size_t n)
+{
+    uint8_t data[MAX_BLOCK];
+    if (algo == COMPRESS_NONE || n < 8 || n > MAX_BLOCK) {
+        return n;
+    }
+    compress_synthetic_block(block, data, n);
+    uint64_t size = algo == COMPRESS_BDI ? compress_bdi(data, n) : compress_fpc(data, n);
+    return (size + COMPRESS_SEGMENT - 1) / COMPRESS_SEGMENT * COMPRESS_SEGMENT;
+}
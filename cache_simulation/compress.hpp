@@ -0,0 +1,31 @@
+/**
+ * @file compress.hpp
+ * @brief Block compression for the compressed L2 mode
+ *
+ * Implements Base-Delta-Immediate and Frequent Pattern Compression on block
+ * contents. Traces carry no data, so the contents come from a synthetic model
+ * seeded by the block number: a fixed mix of zero blocks, repeated values,
+ * narrow integers, pointers into a common region and random data. A block
+ * always has the same contents, so writes don't change its compressed size.
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum compress_t {
+    COMPRESS_NONE = 0,
+    COMPRESS_BDI = 1,
+    COMPRESS_FPC = 2
+};
+
+static const uint64_t COMPRESS_SEGMENT = 8; // compressed blocks are stored in 8 byte segments
+
+void compress_synthetic_block(uint64_t block, uint8_t *data, size_t n);
+uint64_t compress_bdi(const uint8_t *data, size_t n);
+uint64_t compress_fpc(const uint8_t *data, size_t n);
+uint64_t compressed_size(uint64_t algo, uint64_t block, size_t n);
+
+#endif // COMPRESS_H
@@ -0,0 +1,239 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "dram.hpp"
+
+// Address fields in the order they appear in the mapping string
+enum dram_field_t { F_ROW, F_RANK, F_BANK, F_CHANNEL, F_COLUMN, NUM_FIELDS };
+
+static struct dram_config_t dconf;
+static int64_t *open_row;               // one row buffer per (channel, rank, bank)
+static uint64_t block_bits;
+static uint64_t field_bits[NUM_FIELDS]; // the row is whatever is left
+static int field_order[NUM_FIELDS];     // least significant field first
+
+dram_config_t::dram_config_t() : enabled(0), channels(DEFAULT_DRAM_CHANNELS), ranks(DEFAULT_DRAM_RANKS),
+                                 banks(DEFAULT_DRAM_BANKS), row_bytes(DEFAULT_DRAM_ROW_BYTES),
+                                 page_policy(DRAM_OPEN_PAGE), tCAS(DEFAULT_DRAM_tCAS), tRCD(DEFAULT_DRAM_tRCD),
+                                 tRP(DEFAULT_DRAM_tRP), tBURST(DEFAULT_DRAM_tBURST)
+{
+    strncpy(map, DEFAULT_DRAM_MAP, sizeof(map));
+}
+
+static uint64_t log2_exact(uint64_t x)
+{
+    uint64_t n = 0;
+    while ((uint64_t(1) << n) < x) {
+        n++;
+    }
+    return n;
+}
+
+static bool is_pow2(uint64_t x)
+{
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+// Parses a mapping string such as "RoRaBaChCo" into field_order. Every field
+// has to appear exactly once, and the row has to come first since it takes
+// every bit above the other fields.
+static bool parse_map(const char *map, int *order)
+{
+    static const char *names[NUM_FIELDS] = {"Ro", "Ra", "Ba", "Ch", "Co"};
+    int seen[NUM_FIELDS] = {0, 0, 0, 0, 0};
+    size_t len = strlen(map);
+
+    if (len != 2 * NUM_FIELDS) {
+        return false;
+    }
+    for (size_t i = 0; i < NUM_FIELDS; i++) {
+        const char *tok = map + 2 * i;
+        int f = -1;
+        for (int j = 0; j < NUM_FIELDS; j++) {
+            if (strncmp(tok, names[j], 2) == 0) {
+                f = j;
+            }
+        }
+        if (f < 0 || seen[f]) {
+            return false;
+        }
+        seen[f] = 1;
+        order[NUM_FIELDS - 1 - i] = f;
+    }
+    return order[NUM_FIELDS - 1] == F_ROW;
+}
+
+// A whole unsigned number in decimal, hex (0x) or octal (0), nothing else
+static bool parse_number(const char *val, uint64_t *num)
+{
+    char *end;
+    if (*val < '0' || *val > '9') {
+        return false;
+    }
+    *num = strtoull(val, &end, 0);
+    return *end == '\0';
+}
+
+/** @brief Parses a DRAM description of the form "key=value,key=value,..."
+ *
+ *  Keys are ch, ra, ba, row, page (open/closed), map, tCAS, tRCD, tRP and
+ *  tBURST. An empty string or "on" keeps the defaults. Numbers may be
+ *  decimal, hex or octal, and the timings must be non-zero.
+ *
+ *  @param spec the description from the command line
+ *  @param conf the configuration to update, enabled on success
+ *  @return false if the description is malformed
+ */
+bool dram_parse_config(const char *spec, struct dram_config_t *conf)
+{
+    char buf[256];
+    strncpy(buf, spec, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    conf->enabled = 1;
+    if (strcmp(buf, "") == 0 || strcmp(buf, "on") == 0) {
+        return true;
+    }
+
+    for (char *tok = strtok(buf, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        char *eq = strchr(tok, '=');
+        if (eq == NULL) {
+            return false;
+        }
+        *eq = '\0';
+        const char *key = tok;
+        const char *val = eq + 1;
+        uint64_t num = 0;
+        bool numeric = strcmp(key, "page") != 0 && strcmp(key, "map") != 0;
+        if (numeric && !parse_number(val, &num)) {
+            return false;
+        }
+        if (key[0] == 't' && num == 0) { // tCAS, tRCD, tRP and tBURST take at least a cycle
+            return false;
+        }
+
+        if (strcmp(key, "ch") == 0) {
+            conf->channels = num;
+        } else if (strcmp(key, "ra") == 0) {
+            conf->ranks = num;
+        } else if (strcmp(key, "ba") == 0) {
+            conf->banks = num;
+        } else if (strcmp(key, "row") == 0) {
+            conf->row_bytes = num;
+        } else if (strcmp(key, "tCAS") == 0) {
+            conf->tCAS = num;
+        } else if (strcmp(key, "tRCD") == 0) {
+            conf->tRCD = num;
+        } else if (strcmp(key, "tRP") == 0) {
+            conf->tRP = num;
+        } else if (strcmp(key, "tBURST") == 0) {
+            conf->tBURST = num;
+        } else if (strcmp(key, "page") == 0) {
+            if (strcmp(val, "open") == 0) {
+                conf->page_policy = DRAM_OPEN_PAGE;
+            } else if (strcmp(val, "closed") == 0) {
+                conf->page_policy = DRAM_CLOSED_PAGE;
+            } else {
+                return false;
+            }
+        } else if (strcmp(key, "map") == 0) {
+            int order[NUM_FIELDS];
+            if (!parse_map(val, order)) {
+                return false;
+            }
+            strncpy(conf->map, val, sizeof(conf->map) - 1);
+            conf->map[sizeof(conf->map) - 1] = '\0';
+        } else {
+            return false;
+        }
+    }
+
+    return is_pow2(conf->channels) && is_pow2(conf->ranks) && is_pow2(conf->banks) && is_pow2(conf->row_bytes);
+}
+
+/** @brief Sets up the bank state for a validated configuration
+ *
+ *  @param conf the DRAM configuration
+ *  @param b log2 of the cache block size, the unit of every DRAM request
+ */
+void dram_init(const struct dram_config_t *conf, uint64_t b)
+{
+    dconf = *conf;
+    block_bits = b;
+
+    parse_map(dconf.map, field_order);
+    field_bits[F_CHANNEL] = log2_exact(dconf.channels);
+    field_bits[F_RANK] = log2_exact(dconf.ranks);
+    field_bits[F_BANK] = log2_exact(dconf.banks);
+    field_bits[F_COLUMN] = log2_exact(dconf.row_bytes) > b ? log2_exact(dconf.row_bytes) - b : 0;
+
+    uint64_t num_banks = dconf.channels * dconf.ranks * dconf.banks;
+    open_row = new int64_t[num_banks];
+    for (uint64_t i = 0; i < num_banks; i++) {
+        open_row[i] = -1;
+    }
+}
+
+/** @brief Services one block-sized request and returns its latency
+ *
+ *  @param addr any byte address inside the block
+ *  @param type demand read, prefetch read or write back
+ *  @param stats the DRAM statistics to update
+ */
+uint64_t dram_access(uint64_t addr, dram_req_t type, struct dram_stats_t *stats)
+{
+    uint64_t fields[NUM_FIELDS] = {0, 0, 0, 0, 0};
+    uint64_t rest = addr >> block_bits;
+
+    for (int i = 0; i < NUM_FIELDS - 1; i++) {
+        int f = field_order[i];
+        fields[f] = rest & ((uint64_t(1) << field_bits[f]) - 1);
+        rest >>= field_bits[f];
+    }
+    fields[F_ROW] = rest;
+
+    uint64_t bank = (fields[F_CHANNEL] * dconf.ranks + fields[F_RANK]) * dconf.banks + fields[F_BANK];
+    int64_t row = int64_t(fields[F_ROW]);
+    uint64_t latency;
+
+    if (open_row[bank] == row) {
+        stats->num_row_hits++;
+        latency = dconf.tCAS + dconf.tBURST;
+    } else if (open_row[bank] == -1) {
+        stats->num_row_empty++;
+        latency = dconf.tRCD + dconf.tCAS + dconf.tBURST;
+    } else {
+        stats->num_row_conflicts++;
+        latency = dconf.tRP + dconf.tRCD + dconf.tCAS + dconf.tBURST;
+    }
+
+    // closed page precharges right after the access, so the precharge is
+    // off the critical path of the next request
+    open_row[bank] = dconf.page_policy == DRAM_OPEN_PAGE ? row : -1;
+
+    if (type == DRAM_READ) {
+        stats->num_reads++;
+        stats->total_read_latency += latency;
+    } else if (type == DRAM_PREFETCH) {
+        stats->num_prefetch_reads++;
+    } else {
+        stats->num_writes++;
+    }
+
+    return latency;
+}
+
+/** @brief Frees the bank state and finalizes the DRAM statistics
+ *
+ *  @param stats the DRAM statistics to finalize
+ */
+void dram_cleanup(struct dram_stats_t *stats)
+{
+    uint64_t requests = stats->num_row_hits + stats->num_row_empty + stats->num_row_conflicts;
+
+    stats->row_hit_rate = requests ? double(stats->num_row_hits) / double(requests) : 0;
+    stats->avg_read_latency = stats->num_reads ? double(stats->total_read_latency) / double(stats->num_reads) : 0;
+
+    delete[] open_row;
+    open_row = NULL;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file dram.hpp
+ * @brief DRAM timing model used behind the L2 in place of the flat HIT_TIME_MEM
+ *
+ * Models channels, ranks and banks with one row buffer per bank, an open or
+ * closed page policy and tRCD/tRP/tCAS-style timings. There is no global
+ * clock in the cache simulator, so requests are not queued against each
+ * other; the latency of a request depends only on the row buffer state of
+ * its bank.
+ */
+
+#ifndef DRAM_H
+#define DRAM_H
+
+#include <cstdint>
+
+// Default DRAM configuration (timings are in the same units as HIT_TIME_*)
+static const uint64_t DEFAULT_DRAM_CHANNELS = 1;
+static const uint64_t DEFAULT_DRAM_RANKS = 1;
+static const uint64_t DEFAULT_DRAM_BANKS = 8;
+static const uint64_t DEFAULT_DRAM_ROW_BYTES = 8192;
+static const uint64_t DEFAULT_DRAM_tCAS = 24;
+static const uint64_t DEFAULT_DRAM_tRCD = 24;
+static const uint64_t DEFAULT_DRAM_tRP = 24;
+static const uint64_t DEFAULT_DRAM_tBURST = 8;
+static const char DEFAULT_DRAM_MAP[] = "RoRaBaChCo"; // most to least significant
+
+enum dram_page_policy_t {
+    DRAM_OPEN_PAGE = 0,
+    DRAM_CLOSED_PAGE = 1
+};
+
+// Struct for keeping the DRAM parameters
+struct dram_config_t {
+    uint8_t enabled;        // FALSE keeps the flat HIT_TIME_MEM model
+    uint64_t channels;
+    uint64_t ranks;         // ranks per channel
+    uint64_t banks;         // banks per rank
+    uint64_t row_bytes;     // row buffer size
+    uint64_t page_policy;   // dram_page_policy_t
+    uint64_t tCAS;
+    uint64_t tRCD;
+    uint64_t tRP;
+    uint64_t tBURST;
+    char map[16];           // address mapping, e.g. "RoRaBaChCo"
+
+    dram_config_t();
+};
+
+// Struct for keeping track of DRAM statistics
+struct dram_stats_t {
+    uint64_t num_reads;                     // demand fills from the L2
+    uint64_t num_prefetch_reads;            // prefetch fills from the L2
+    uint64_t num_writes;                    // L2 write backs
+    uint64_t num_row_hits;                  // row buffer hits
+    uint64_t num_row_empty;                 // accesses to a precharged bank
+    uint64_t num_row_conflicts;             // accesses that had to close another row
+    uint64_t total_read_latency;            // summed latency of demand fills
+
+    double row_hit_rate;                    // row buffer hit rate over all requests
+    double avg_read_latency;                // average demand fill latency
+};
+
+enum dram_req_t {
+    DRAM_READ = 0,
+    DRAM_PREFETCH = 1,
+    DRAM_WRITE = 2
+};
+
+bool dram_parse_config(const char *spec, struct dram_config_t *conf);
+void dram_init(const struct dram_config_t *conf, uint64_t b);
+uint64_t dram_access(uint64_t addr, dram_req_t type, struct dram_stats_t *stats);
+void dram_cleanup(struct dram_stats_t *stats);
+
+#endif // DRAM_H
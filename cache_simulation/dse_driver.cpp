@@ -0,0 +1,353 @@
+/**
+ * @file dse_driver.cpp
+ * @brief Adaptive design-space exploration over c/s/C/S/v/k
+ *
+ * For every total capacity budget (L1 + L2 + VC bytes) in a range of powers
+ * of two, runs coordinate descent on the average access time, warm started
+ * from the best point of the previous budget. All values of one coordinate
+ * are simulated in parallel, one forked process per configuration since the
+ * simulator keeps its state in globals. The trace is read once before the
+ * workers are forked.
+ *
+ * A worker stops early when its AAT lower bound, the misses so far weighted
+ * by the hit times over the whole trace, exceeds the AAT of a finished
+ * configuration of no more capacity. Such a configuration is dominated, so
+ * it can be neither on the Pareto front nor the best point of a budget.
+ */
+
+#include <getopt.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cache.hpp"
+#include "trace_reader.hpp"
+
+static const size_t DSE_INTERVAL = 1 << 16; // accesses between early termination checks
+static const uint64_t DSE_VC_SIZES[] = {0, 2, 4, 8, 16};
+static const uint64_t DSE_MAX_K = 4;
+static const uint64_t DSE_MIN_c = 10;
+
+struct point {
+    uint64_t c, s, C, S, v, k;
+
+    bool operator<(const point &o) const
+    {
+        const uint64_t a[] = {c, s, C, S, v, k};
+        const uint64_t b[] = {o.c, o.s, o.C, o.S, o.v, o.k};
+        return std::lexicographical_compare(a, a + 6, b, b + 6);
+    }
+};
+
+struct result {
+    uint8_t pruned;
+    struct cache_stats_t stats;
+};
+
+static uint64_t *trace_addrs;
+static char *trace_rws;
+static size_t trace_len;
+static uint64_t block_bits = DEFAULT_b;
+static uint64_t max_assoc = 4;              // log2 of the largest associativity tried
+static long jobs;
+static std::map<point, result> evaluated;
+static uint64_t num_pruned;
+
+struct trace_buffer {
+    std::vector<uint64_t> addrs;
+    std::vector<char> rws;
+};
+
+static void load_chunk(const uint64_t *addrs, const char *rws, size_t n, void *arg)
+{
+    struct trace_buffer *buf = static_cast<struct trace_buffer *>(arg);
+    buf->addrs.insert(buf->addrs.end(), addrs, addrs + n);
+    buf->rws.insert(buf->rws.end(), rws, rws + n);
+}
+
+static void print_err_usage(std::string err)
+{
+    std::cout << err << std::endl;
+    std::cout << "./cachesim_dse [OPTIONS] -i <tracename.trace>" << std::endl;
+    std::cout << "    -b b        Block size is 2^b bytes" << std::endl;
+    std::cout << "    -j N        Simulate up to N configurations at once (default: all cores)" << std::endl;
+    std::cout << "    -a A        Try associativities up to 2^A" << std::endl;
+    std::cout << "    --budget LO:HI" << std::endl;
+    std::cout << "                Capacity budgets 2^LO .. 2^HI bytes (default 15:20)" << std::endl;
+    std::exit(EXIT_FAILURE);
+}
+
+static uint64_t capacity(const point &p)
+{
+    return (uint64_t(1) << p.c) + (uint64_t(1) << p.C) + p.v * (uint64_t(1) << block_bits);
+}
+
+static bool valid(const point &p, uint64_t budget)
+{
+    return p.c >= DSE_MIN_c && p.c < p.C && p.c >= block_bits + p.s && p.C >= block_bits + p.S &&
+           p.s <= max_assoc && p.S <= max_assoc && capacity(p) <= budget;
+}
+
+// Smallest AAT of a finished configuration with at most the given capacity
+static double best_within(uint64_t cap, const point **where)
+{
+    double best = std::numeric_limits<double>::infinity();
+    for (const auto &e : evaluated) {
+        if (!e.second.pruned && capacity(e.first) <= cap && e.second.stats.avg_access_time < best) {
+            best = e.second.stats.avg_access_time;
+            if (where) {
+                *where = &e.first;
+            }
+        }
+    }
+    return best;
+}
+
+static void run_point(const point &p, double threshold, int fd)
+{
+    struct cache_config_t conf;
+    conf.c = p.c;
+    conf.s = p.s;
+    conf.C = p.C;
+    conf.S = p.S;
+    conf.b = block_bits;
+    conf.v = p.v;
+    conf.k = p.k;
+
+    struct result res;
+    memset(&res, 0, sizeof(res));
+    struct cache_stats_t &stats = res.stats;
+    stats.hit_time_l1 = HIT_TIME_L1_BASE + ADJUSTMENT_FACTOR_L1 * (double) conf.s;
+    stats.hit_time_l2 = HIT_TIME_L2_BASE + ADJUSTMENT_FACTOR_L2 * (double) conf.S;
+    stats.hit_time_mem = HIT_TIME_MEM;
+
+    cache_init(&conf);
+    for (size_t i = 0; i < trace_len; i += DSE_INTERVAL) {
+        size_t n = trace_len - i < DSE_INTERVAL ? trace_len - i : DSE_INTERVAL;
+        cache_access_batch(trace_addrs + i, trace_rws + i, n, &stats);
+
+        // misses only grow, and every remaining access costs at least an L1 hit
+        double bound = stats.hit_time_l1 + (double(stats.num_misses_vc) * stats.hit_time_l2 +
+                                            double(stats.num_misses_l2) * stats.hit_time_mem) / double(trace_len);
+        if (bound > threshold * (1 + 1e-9)) {
+            res.pruned = TRUE;
+            break;
+        }
+    }
+    if (!res.pruned) {
+        cache_cleanup(&stats);
+    }
+
+    ssize_t ret = write(fd, &res, sizeof(res));
+    _exit(ret == ssize_t(sizeof(res)) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+// Simulates every point not seen yet, at most jobs at a time
+static void evaluate(const std::vector<point> &points)
+{
+    std::map<pid_t, std::pair<point, int> > running;
+    size_t next = 0;
+
+    while (next < points.size() || !running.empty()) {
+        while (next < points.size() && long(running.size()) < jobs) {
+            const point &p = points[next++];
+            if (evaluated.count(p)) {
+                continue;
+            }
+            int fds[2];
+            if (pipe(fds) != 0) {
+                perror("pipe");
+                std::exit(EXIT_FAILURE);
+            }
+            double threshold = best_within(capacity(p), NULL);
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                std::exit(EXIT_FAILURE);
+            }
+            if (pid == 0) {
+                close(fds[0]);
+                run_point(p, threshold, fds[1]);
+            }
+            close(fds[1]);
+            running[pid] = std::make_pair(p, fds[0]);
+        }
+        if (running.empty()) {
+            break;
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+        auto it = running.find(pid);
+        if (it == running.end()) {
+            continue;
+        }
+        struct result res;
+        ssize_t got = read(it->second.second, &res, sizeof(res));
+        close(it->second.second);
+        if (got != ssize_t(sizeof(res)) || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            std::cerr << "Worker for c=" << it->second.first.c << " C=" << it->second.first.C << " failed" << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        evaluated[it->second.first] = res;
+        num_pruned += res.pruned;
+        running.erase(it);
+    }
+}
+
+// All values of one coordinate around p
+static std::vector<point> line(const point &p, int coord, uint64_t budget)
+{
+    std::vector<point> out;
+    std::vector<uint64_t> values;
+    if (coord == 4) {
+        values.assign(DSE_VC_SIZES, DSE_VC_SIZES + sizeof(DSE_VC_SIZES) / sizeof(DSE_VC_SIZES[0]));
+    } else {
+        for (uint64_t x = 0; x <= 40; x++) {
+            values.push_back(x);
+        }
+    }
+    for (uint64_t x : values) {
+        point q = p;
+        uint64_t *field[] = {&q.c, &q.s, &q.C, &q.S, &q.v, &q.k};
+        *field[coord] = x;
+        if (valid(q, budget) && q.k <= DSE_MAX_K) {
+            out.push_back(q);
+        }
+    }
+    return out;
+}
+
+static point descend(point start, uint64_t budget)
+{
+    point best = start;
+    evaluate(std::vector<point>(1, best));
+
+    for (bool improved = true; improved;) {
+        improved = false;
+        for (int coord = 0; coord < 6; coord++) {
+            evaluate(line(best, coord, budget));
+            const point *where = NULL;
+            double aat = best_within(budget, &where);
+            if (where && aat < evaluated[best].stats.avg_access_time) {
+                best = *where;
+                improved = true;
+            }
+        }
+    }
+    return best;
+}
+
+static void print_point(const point &p)
+{
+    std::cout << std::setw(9) << capacity(p) << "  c=" << std::setw(2) << p.c << " s=" << p.s << " C="
+              << std::setw(2) << p.C << " S=" << p.S << " v=" << std::setw(2) << p.v << " k=" << p.k
+              << "  AAT " << std::setprecision(6) << evaluated[p].stats.avg_access_time << std::endl;
+}
+
+int main(int argc, char *const argv[])
+{
+    int opt;
+    FILE *fin = NULL;
+    uint64_t budget_lo = 15;
+    uint64_t budget_hi = 20;
+
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    enum { OPT_BUDGET = 256 };
+    static const struct option long_opts[] = {
+        {"budget", required_argument, NULL, OPT_BUDGET},
+        {NULL, 0, NULL, 0}
+    };
+
+    while (-1 != (opt = getopt_long(argc, argv, "i:b:j:a:h", long_opts, NULL))) {
+        switch (opt) {
+            case 'i':
+                fin = fopen(optarg, "r");
+                break;
+            case 'b':
+                block_bits = (uint64_t) atoi(optarg);
+                break;
+            case 'j':
+                jobs = atol(optarg);
+                break;
+            case 'a':
+                max_assoc = (uint64_t) atoi(optarg);
+                break;
+            case OPT_BUDGET:
+                if (sscanf(optarg, "%" SCNu64 ":%" SCNu64, &budget_lo, &budget_hi) != 2) {
+                    print_err_usage("Budget must be LO:HI");
+                }
+                break;
+            case 'h':
+            default:
+                print_err_usage("");
+                break;
+        }
+    }
+    if (fin == NULL) {
+        print_err_usage("Input file argument not provided");
+    }
+    if (jobs < 1 || budget_lo > budget_hi || budget_lo < DSE_MIN_c + 4 || budget_hi > 40) {
+        print_err_usage("Invalid job count or budget range");
+    }
+
+    struct trace_buffer buf;
+    struct trace_error_t err;
+    if (!trace_read(fin, trace_default_threads(), load_chunk, &buf, &err)) {
+        std::cerr << "Trace line " << err.line << ": " << err.message << std::endl;
+        return EXIT_FAILURE;
+    }
+    fclose(fin);
+    trace_addrs = buf.addrs.data();
+    trace_rws = buf.rws.data();
+    trace_len = buf.addrs.size();
+    if (trace_len == 0) {
+        print_err_usage("Empty trace");
+    }
+
+    std::cout << std::fixed;
+    std::cout << "Best configuration per capacity budget" << std::endl;
+
+    // start with half the budget in a 4-way L2 and an eighth of it in a 2-way L1
+    point best = {budget_lo - 4, 1, budget_lo - 1, 2, 0, 0};
+    for (uint64_t B = budget_lo; B <= budget_hi; B++) {
+        best = descend(best, uint64_t(1) << B);
+        std::cout << "2^" << B << ": ";
+        print_point(best);
+    }
+
+    std::vector<point> done;
+    for (const auto &e : evaluated) {
+        if (!e.second.pruned) {
+            done.push_back(e.first);
+        }
+    }
+    std::sort(done.begin(), done.end(), [](const point &a, const point &b) {
+        uint64_t ca = capacity(a), cb = capacity(b);
+        return ca != cb ? ca < cb : evaluated[a].stats.avg_access_time < evaluated[b].stats.avg_access_time;
+    });
+
+    std::cout << std::endl << "Pareto front (capacity in bytes, AAT)" << std::endl;
+    double front = std::numeric_limits<double>::infinity();
+    for (const point &p : done) {
+        if (evaluated[p].stats.avg_access_time < front) {
+            front = evaluated[p].stats.avg_access_time;
+            print_point(p);
+        }
+    }
+
+    std::cout << std::endl << "Simulated " << evaluated.size() << " configurations, " << num_pruned
+              << " stopped early" << std::endl;
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <iterator>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "opt.hpp"
+#include "trace_reader.hpp"
+
+static const uint64_t NEVER = UINT64_MAX; // next use of a block that isn't used again
+
+// Misses of one level of 2^set_bits sets and the given ways under OPT. The
+// blocks that miss are appended to misses, if given.
+static uint64_t opt_level(const std::vector<uint64_t> &blocks, uint64_t set_bits, uint64_t ways,
+                          std::vector<uint64_t> *misses)
+{
+    std::vector<uint64_t> next(blocks.size());
+    std::unordered_map<uint64_t, uint64_t> seen; // block -> its next use
+    for (size_t i = blocks.size(); i-- > 0;) {
+        auto it = seen.find(blocks[i]);
+        next[i] = it == seen.end() ? NEVER : it->second;
+        seen[blocks[i]] = i;
+    }
+
+    // every set ordered by next use, so the victim is the last element
+    std::vector<std::set<std::pair<uint64_t, uint64_t> > > sets(size_t(1) << set_bits);
+    std::unordered_map<uint64_t, uint64_t> &resident = seen; // block -> next use, for blocks in the cache
+    resident.clear();
+    uint64_t mask = (uint64_t(1) << set_bits) - 1;
+    uint64_t num_misses = 0;
+
+    for (size_t i = 0; i < blocks.size(); i++) {
+        uint64_t block = blocks[i];
+        std::set<std::pair<uint64_t, uint64_t> > &set = sets[block & mask];
+        auto it = resident.find(block);
+        if (it != resident.end()) {
+            set.erase(std::make_pair(it->second, block));
+        } else {
+            num_misses++;
+            if (misses) {
+                misses->push_back(block);
+            }
+            if (set.size() == ways) {
+                auto victim = std::prev(set.end());
+                resident.erase(victim->second);
+                set.erase(victim);
+            }
+        }
+        set.insert(std::make_pair(next[i], block));
+        resident[block] = next[i];
+    }
+    return num_misses;
+}
+
+struct block_list {
+    std::vector<uint64_t> blocks;
+    uint64_t b;
+};
+
+static void collect_blocks(const uint64_t *addrs, const char *, size_t n, void *arg)
+{
+    struct block_list *list = static_cast<struct block_list *>(arg);
+    for (size_t i = 0; i < n; i++) {
+        list->blocks.push_back(addrs[i] >> list->b);
+    }
+}
+
+/** @brief Simulates OPT replacement over a whole trace
+ *
+ *  @param in the trace, read to the end
+ *  @param conf the geometry to bound
+ *  @param stats where to store the OPT miss counts and rates
+ *  @return false if the trace has no accesses or a malformed line
+ */
+bool opt_run(FILE *in, const struct cache_config_t *conf, struct cache_stats_t *stats)
+{
+    struct block_list list;
+    list.b = conf->b;
+    struct trace_error_t err;
+    if (!trace_read(in, trace_default_threads(), collect_blocks, &list, &err) || list.blocks.empty()) {
+        return false;
+    }
+    std::vector<uint64_t> &blocks = list.blocks;
+
+    uint64_t accesses = blocks.size();
+    std::vector<uint64_t> l2_blocks;
+    stats->num_opt_misses_l1 = opt_level(blocks, conf->c - conf->s - conf->b, uint64_t(1) << conf->s, &l2_blocks);
+    blocks.clear();
+    blocks.shrink_to_fit();
+    stats->num_opt_misses_l2 = opt_level(l2_blocks, conf->C - conf->S - conf->b, uint64_t(1) << conf->S, NULL);
+
+    stats->opt_miss_rate_l1 = double(stats->num_opt_misses_l1) / double(accesses);
+    stats->opt_miss_rate_l2 = stats->num_opt_misses_l1 ?
+        double(stats->num_opt_misses_l2) / double(stats->num_opt_misses_l1) : 0;
+    return true;
+}
@@ -0,0 +1,23 @@
+/**
+ * @file opt.hpp
+ * @brief Belady's OPT replacement, as a bound for the LRU results
+ *
+ * A first pass reads the whole trace and, scanning it backwards, finds the
+ * next use of every access's block. A second pass runs the L1 geometry with
+ * evict-furthest-in-future, keeping every set ordered by next use, and its
+ * misses form the reference stream of an L2 run with the L2 geometry. Both
+ * levels use the plain bit-slice index and allocate on every miss; the VC,
+ * prefetches and write backs are left out, so the L2 figures bound the
+ * demand misses only.
+ */
+
+#ifndef OPT_H
+#define OPT_H
+
+#include <cstdio>
+
+#include "cache.hpp"
+
+bool opt_run(FILE *in, const struct cache_config_t *conf, struct cache_stats_t *stats);
+
+#endif // OPT_H
@@ -0,0 +1,121 @@
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "outcome.hpp"
+
+static const size_t OUTCOME_BUFFER = 1 << 20; // bytes per buffer
+
+static FILE *out;
+static uint8_t buffers[2][OUTCOME_BUFFER];
+static uint8_t *current;                // buffer being packed
+static size_t used;                     // bytes of it complete
+static bool half;                       // the low nibble of current[used] is filled
+static uint64_t records;
+
+// Hand-off to the writer thread: at most one buffer is in flight
+static std::thread writer;
+static std::mutex lock;
+static std::condition_variable ready;
+static const uint8_t *pending;
+static size_t pending_len;
+static bool closing;
+static bool failed;
+
+static void write_loop()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        ready.wait(guard, [] { return pending != NULL || closing; });
+        if (pending == NULL) {
+            return;
+        }
+        const uint8_t *data = pending;
+        size_t len = pending_len;
+        guard.unlock();
+        bool ok = fwrite(data, 1, len, out) == len;
+        guard.lock();
+        failed = failed || !ok;
+        pending = NULL;
+        ready.notify_all();
+    }
+}
+
+// Waits for the writer to take the previous buffer, then hands it this one
+static void flush(size_t len)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    ready.wait(guard, [] { return pending == NULL; });
+    pending = current;
+    pending_len = len;
+    ready.notify_all();
+    guard.unlock();
+    current = current == buffers[0] ? buffers[1] : buffers[0];
+}
+
+/** @brief Starts an outcome stream
+ *
+ *  @param f where to write it, opened for binary writing
+ *  @return false if the header can't be written
+ */
+bool outcome_open(FILE *f)
+{
+    uint64_t header[OUTCOME_HEADER_FIELDS];
+    header[OH_VERSION] = OUTCOME_VERSION;
+    header[OH_BITS] = 4;
+    header[OH_RECORDS] = OUTCOME_UNKNOWN;
+    out = f;
+    if (fwrite(OUTCOME_MAGIC, sizeof(OUTCOME_MAGIC), 1, out) != 1 || fwrite(header, sizeof(header), 1, out) != 1) {
+        return false;
+    }
+
+    current = buffers[0];
+    used = 0;
+    half = false;
+    records = 0;
+    pending = NULL;
+    closing = false;
+    failed = false;
+    writer = std::thread(write_loop);
+    return true;
+}
+
+/** @brief Appends the record of one access
+ *
+ *  @param record an outcome_level_t ORed with outcome_flag_t bits
+ */
+void outcome_put(uint8_t record)
+{
+    records++;
+    if (!half) {
+        current[used] = record;
+        half = true;
+        return;
+    }
+    current[used] = uint8_t(current[used] | record << 4);
+    half = false;
+    if (++used == OUTCOME_BUFFER) {
+        flush(used);
+        used = 0;
+    }
+}
+
+/** @brief Writes the rest of the stream and the record count
+ *
+ *  @return false if any write failed
+ */
+bool outcome_close()
+{
+    flush(used + (half ? 1 : 0));
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closing = true;
+    }
+    ready.notify_all();
+    writer.join();
+
+    if (fseek(out, long(sizeof(OUTCOME_MAGIC) + OH_RECORDS * sizeof(uint64_t)), SEEK_SET) == 0) {
+        failed = failed || fwrite(&records, sizeof(records), 1, out) != 1;
+    }
+    return !failed;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file outcome.hpp
+ * @brief Per-access outcome stream for driving other models
+ *
+ * One 4-bit record per access, two to a byte with the earlier access in the
+ * low nibble: the level that serviced it in the low two bits, then whether
+ * it hit a prefetched L2 line and whether it caused an L2 write back. The
+ * file starts with OUTCOME_MAGIC and OUTCOME_HEADER_FIELDS 64-bit fields in
+ * host byte order. The record count is filled in when the stream is closed;
+ * on an output that can't seek it stays OUTCOME_UNKNOWN and the records run
+ * to the end of the file.
+ *
+ * Records are packed into one buffer while a background thread writes the
+ * previous one, so the simulation only waits when the disk falls behind.
+ */
+
+#ifndef OUTCOME_H
+#define OUTCOME_H
+
+#include <cstdint>
+#include <cstdio>
+
+enum outcome_level_t {
+    OUTCOME_L1 = 0,
+    OUTCOME_VC = 1,     // the VC, a miss cache or a stream buffer
+    OUTCOME_L2 = 2,
+    OUTCOME_MEM = 3
+};
+
+enum outcome_flag_t {
+    OUTCOME_USEFUL_PREFETCH = 4,
+    OUTCOME_WRITE_BACK = 8
+};
+
+enum outcome_field_t {
+    OH_VERSION, OH_BITS, OH_RECORDS,
+    OUTCOME_HEADER_FIELDS
+};
+
+static const char OUTCOME_MAGIC[8] = {'C', 'S', 'I', 'M', 'O', 'U', 'T', '\0'};
+static const uint64_t OUTCOME_VERSION = 1;
+static const uint64_t OUTCOME_UNKNOWN = UINT64_MAX;
+
+bool outcome_open(FILE *out);
+void outcome_put(uint8_t record);
+bool outcome_close();
+
+#endif // OUTCOME_H
@@ -0,0 +1,28 @@
+/**
+ * @file reference_cache.hpp
+ * @brief The original cache engine, frozen as a reference
+ *
+ * A verbatim copy of the first cache_init/cache_access/cache_cleanup, in its
+ * own namespace so it keeps its own state next to the optimized engine. The
+ * --diff mode runs both over the trace and stops at the first window of
+ * accesses after which they disagree on a statistic. It models only
+ * c/s/C/S/b/v/k.
+ */
+
+#ifndef REFERENCE_CACHE_H
+#define REFERENCE_CACHE_H
+
+#include <cstdio>
+
+#include "cache.hpp"
+
+namespace reference {
+
+void cache_init(struct cache_config_t *conf);
+void cache_access(uint64_t addr, char rw, struct cache_stats_t *stats);
+void cache_cleanup(struct cache_stats_t *stats);
+void reference_dump_sets(FILE *out, uint64_t addr);
+
+} // namespace reference
+
+#endif // REFERENCE_CACHE_H
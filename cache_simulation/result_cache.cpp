@@ -0,0 +1,154 @@
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cinttypes>
+#include <cstring>
+
+#include "result_cache.hpp"
+
+static const size_t DIGEST_CHUNK = 1 << 16;
+static const size_t KEY_MAX = 512;
+
+static uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// Final avalanche so every input bit affects every output bit
+static uint64_t fmix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hash_bytes(uint64_t h, const unsigned char *p, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, sizeof(w));
+        h ^= w * 0x9E3779B97F4A7C15ULL;
+        h = rotl(h, 31) * 0x87C37B91114253D5ULL;
+    }
+    for (; i < n; i++) {
+        h ^= uint64_t(p[i]) * 0x9E3779B97F4A7C15ULL;
+        h = rotl(h, 31) * 0x87C37B91114253D5ULL;
+    }
+    return h;
+}
+
+/** @brief Hashes the whole contents of an input file
+ *
+ *  The file position is restored afterwards.
+ *
+ *  @param in the trace or filtered trace
+ *  @param digest where to store the digest
+ *  @return false if the file is not seekable, e.g. a pipe
+ */
+bool result_cache_digest(FILE *in, uint64_t *digest)
+{
+    long pos = ftell(in);
+    if (pos < 0 || fseek(in, 0, SEEK_SET) != 0) {
+        return false;
+    }
+
+    static unsigned char buf[DIGEST_CHUNK];
+    uint64_t h = 0;
+    uint64_t len = 0;
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        h = hash_bytes(h, buf, n);
+        len += n;
+    }
+    *digest = fmix(h ^ len);
+
+    clearerr(in);
+    return fseek(in, pos, SEEK_SET) == 0;
+}
+
+// Everything the statistics depend on, as text
+static void make_key(char *key, uint64_t digest, const char *mode, const struct cache_config_t *conf)
+{
+    snprintf(key, KEY_MAX,
+             "cachesim %" PRIu64 " %s %016" PRIx64 " stats=%zu c=%" PRIu64 " C=%" PRIu64 " s=%" PRIu64
+             " S=%" PRIu64 " b=%" PRIu64 " v=%" PRIu64 " k=%" PRIu64 " sectors=%" PRIu64 "/%" PRIu64
+             " index=%" PRIu64 "/%" PRIu64 " compress=%" PRIu64 " dead=%" PRIu64 " opt=%" PRIu64
+             " profile=%" PRIu64 " side=%" PRIu64 "/%" PRIu64 "/%" PRIu64 " dram=%u/%" PRIu64 "/%" PRIu64
+             "/%" PRIu64 "/%" PRIu64 "/%" PRIu64 "/%s/%" PRIu64 "/%" PRIu64 "/%" PRIu64 "/%" PRIu64,
+             SIMULATOR_VERSION, mode, digest, sizeof(struct cache_stats_t), conf->c, conf->C, conf->s,
+             conf->S, conf->b, conf->v, conf->k, conf->l1_sectors, conf->l2_sectors, conf->l1_index_fn,
+             conf->l2_index_fn, conf->l2_compress, conf->l2_dead_block, conf->opt, conf->set_profile,
+             conf->miss_cache, conf->stream_buffers, conf->stream_depth, unsigned(conf->dram.enabled),
+             conf->dram.channels, conf->dram.ranks, conf->dram.banks, conf->dram.row_bytes,
+             conf->dram.page_policy, conf->dram.map, conf->dram.tCAS, conf->dram.tRCD, conf->dram.tRP,
+             conf->dram.tBURST);
+}
+
+static void entry_path(char *path, size_t size, const char *dir, const char *key)
+{
+    uint64_t h = fmix(hash_bytes(0, reinterpret_cast<const unsigned char *>(key), strlen(key)));
+    snprintf(path, size, "%s/%016" PRIx64 ".res", dir, h);
+}
+
+/** @brief Looks up the statistics of a finished simulation
+ *
+ *  @param dir the store directory
+ *  @param digest digest of the input file
+ *  @param mode how the input file is read, e.g. "trace" or "replay"
+ *  @param conf the full configuration
+ *  @param stats where to store the statistics on a hit
+ *  @return true on a hit
+ */
+bool result_cache_lookup(const char *dir, uint64_t digest, const char *mode,
+                         const struct cache_config_t *conf, struct cache_stats_t *stats)
+{
+    char key[KEY_MAX];
+    char stored[KEY_MAX];
+    char path[KEY_MAX];
+    make_key(key, digest, mode, conf);
+    entry_path(path, sizeof(path), dir, key);
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    bool hit = fgets(stored, sizeof(stored), f) != NULL && strncmp(stored, key, strlen(key)) == 0 &&
+               stored[strlen(key)] == '\n' && fread(stats, sizeof(*stats), 1, f) == 1;
+    fclose(f);
+    return hit;
+}
+
+/** @brief Adds the statistics of a finished simulation to the store
+ *
+ *  Failures are ignored; the store is only an accelerator.
+ *
+ *  @param dir the store directory, created if missing
+ *  @param digest digest of the input file
+ *  @param mode how the input file is read, e.g. "trace" or "replay"
+ *  @param conf the full configuration
+ *  @param stats the final statistics
+ */
+void result_cache_store(const char *dir, uint64_t digest, const char *mode,
+                        const struct cache_config_t *conf, const struct cache_stats_t *stats)
+{
+    char key[KEY_MAX];
+    char path[KEY_MAX];
+    char tmp[KEY_MAX + 32];
+    make_key(key, digest, mode, conf);
+    entry_path(path, sizeof(path), dir, key);
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, long(getpid()));
+
+    mkdir(dir, 0777);
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) {
+        return;
+    }
+    bool ok = fprintf(f, "%s\n", key) > 0 && fwrite(stats, sizeof(*stats), 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+    }
+}
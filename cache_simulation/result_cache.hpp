@@ -0,0 +1,27 @@
+/**
+ * @file result_cache.hpp
+ * @brief On-disk store of finished simulations, keyed by trace contents and configuration
+ *
+ * Every entry is one file in the store directory, named after a hash of its
+ * key. The key spells out the simulator version, a digest of the input file
+ * and every cache_config_t field, and is kept at the top of the entry so a
+ * hash collision reads as a miss. Entries are written to a temporary file and
+ * renamed into place, so concurrent writers on one machine never expose a
+ * partial entry; the last one to finish wins.
+ */
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+
+#include "cache.hpp"
+
+bool result_cache_digest(FILE *in, uint64_t *digest);
+bool result_cache_lookup(const char *dir, uint64_t digest, const char *mode,
+                         const struct cache_config_t *conf, struct cache_stats_t *stats);
+void result_cache_store(const char *dir, uint64_t digest, const char *mode,
+                        const struct cache_config_t *conf, const struct cache_stats_t *stats);
+
+#endif // RESULT_CACHE_H
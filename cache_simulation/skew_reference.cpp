@@ -0,0 +1,213 @@
+/**
+ * @file skew_reference.cpp
+ * @brief Checks skewed set indexing against a true-LRU model
+ *
+ * skew_reference CACHESIM TRACE c s C S b L1_INDEX L2_INDEX runs CACHESIM
+ * over TRACE with no victim cache and no prefetching, and compares its L1
+ * misses, L2 misses and write backs with a model of the same hierarchy that
+ * keeps a timestamp per line: a hit or a fill stamps the line with the number
+ * of the access, a write back new to the L2 goes in just older than the
+ * oldest of its candidate lines, and the victim is the invalid candidate in
+ * the lowest way or else the valid one with the oldest stamp. L1_INDEX and
+ * L2_INDEX are bits or skew.
+ */
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Must hash like skew_hash() in cache.cpp
+static int64_t skew_hash(int64_t block, int64_t set_bits, int64_t way)
+{
+    uint64_t mask = (uint64_t(1) << set_bits) - 1;
+    uint64_t hi = (uint64_t(block) >> set_bits) + uint64_t(way);
+    return int64_t((uint64_t(block) ^ ((hi * 0x9E3779B97F4A7C15ULL) >> 32)) & mask);
+}
+
+struct level {
+    int64_t set_bits;
+    int64_t ways;
+    bool skew;
+    std::vector<int64_t> block, stamp;
+    std::vector<char> valid, dirty;
+
+    level(int64_t size_bits, int64_t way_bits, int64_t b, bool skew)
+        : set_bits(size_bits - way_bits - b), ways(int64_t(1) << way_bits), skew(skew)
+    {
+        size_t lines = size_t(1) << (size_bits - b);
+        block.resize(lines);
+        stamp.resize(lines);
+        valid.resize(lines);
+        dirty.resize(lines);
+    }
+
+    // Line way w of the block can go in
+    size_t slot(int64_t blk, int64_t w) const
+    {
+        int64_t set = skew ? skew_hash(blk, set_bits, w) : blk & ((int64_t(1) << set_bits) - 1);
+        return size_t(set * ways + w);
+    }
+
+    // Line holding the block, or -1
+    int64_t find(int64_t blk) const
+    {
+        for (int64_t w = 0; w < ways; w++) {
+            size_t i = slot(blk, w);
+            if (valid[i] && block[i] == blk) {
+                return int64_t(i);
+            }
+        }
+        return -1;
+    }
+
+    size_t victim(int64_t blk) const
+    {
+        for (int64_t w = 0; w < ways; w++) {
+            if (!valid[slot(blk, w)]) {
+                return slot(blk, w);
+            }
+        }
+        size_t oldest = slot(blk, 0);
+        for (int64_t w = 1; w < ways; w++) {
+            if (stamp[slot(blk, w)] < stamp[oldest]) {
+                oldest = slot(blk, w);
+            }
+        }
+        return oldest;
+    }
+
+    // Oldest stamp among the valid candidate lines of the block
+    int64_t oldest_stamp(int64_t blk) const
+    {
+        int64_t oldest = INT64_MAX;
+        for (int64_t w = 0; w < ways; w++) {
+            size_t i = slot(blk, w);
+            if (valid[i] && stamp[i] < oldest) {
+                oldest = stamp[i];
+            }
+        }
+        return oldest;
+    }
+};
+
+struct counts {
+    uint64_t misses_l1, misses_l2, write_backs;
+};
+
+static void access(level &L1, level &L2, int64_t now, int64_t blk, char rw, counts *n)
+{
+    int64_t hit = L1.find(blk);
+    if (hit != -1) {
+        L1.stamp[size_t(hit)] = now;
+        L1.dirty[size_t(hit)] |= rw == 'W';
+        return;
+    }
+    n->misses_l1++;
+
+    char dirty = rw == 'W';
+    int64_t hit2 = L2.find(blk);
+    if (hit2 != -1) {
+        L2.stamp[size_t(hit2)] = now;
+        dirty |= L2.dirty[size_t(hit2)];
+    } else {
+        n->misses_l2++;
+        size_t i = L2.victim(blk);
+        n->write_backs += L2.valid[i] && L2.dirty[i];
+        L2.block[i] = blk;
+        L2.valid[i] = 1;
+        L2.dirty[i] = 0;
+        L2.stamp[i] = now;
+    }
+
+    size_t i = L1.victim(blk);
+    if (L1.valid[i] && L1.dirty[i]) { // written back into the L2 as its LRU line
+        int64_t old = L1.block[i];
+        int64_t there = L2.find(old);
+        if (there != -1) {
+            L2.dirty[size_t(there)] = 1;
+        } else {
+            int64_t stamp = L2.oldest_stamp(old) - 1;
+            size_t j = L2.victim(old);
+            n->write_backs += L2.valid[j] && L2.dirty[j];
+            L2.block[j] = old;
+            L2.valid[j] = 1;
+            L2.dirty[j] = 1;
+            L2.stamp[j] = stamp;
+        }
+    }
+    L1.block[i] = blk;
+    L1.valid[i] = 1;
+    L1.dirty[i] = dirty;
+    L1.stamp[i] = now;
+}
+
+// Value of the "Number of ...:" line named key in out, or -1
+static int64_t find_count(const std::string &out, const char *key)
+{
+    size_t at = out.find(key);
+    return at == std::string::npos ? -1 : strtoll(out.c_str() + at + strlen(key), NULL, 10);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 10) {
+        fprintf(stderr, "usage: %s CACHESIM TRACE c s C S b bits|skew bits|skew\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int64_t c = atoi(argv[3]), s = atoi(argv[4]), C = atoi(argv[5]), S = atoi(argv[6]), b = atoi(argv[7]);
+    level L1(c, s, b, strcmp(argv[8], "skew") == 0);
+    level L2(C, S, b, strcmp(argv[9], "skew") == 0);
+
+    FILE *in = fopen(argv[2], "r");
+    if (in == NULL) {
+        fprintf(stderr, "Cannot open %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    counts want = {0, 0, 0};
+    uint64_t addr;
+    char rw;
+    // cachesim's block numbers only keep the bits of the low 32 bits of the
+    // address: vic_tag_mask is built with an int shift
+    for (int64_t now = 1; fscanf(in, "%" SCNx64 " %c", &addr, &rw) == 2; now++) {
+        access(L1, L2, now, int64_t((addr & 0xffffffff) >> b), rw, &want);
+    }
+    fclose(in);
+
+    std::string cmd = std::string(argv[1]) + " -c " + argv[3] + " -s " + argv[4] + " -C " + argv[5] + " -S " +
+                      argv[6] + " -b " + argv[7] + " -v 0 -k 0 --l1-index " + argv[8] + " --l2-index " + argv[9] +
+                      " -i " + argv[2];
+    FILE *sim = popen(cmd.c_str(), "r");
+    if (sim == NULL) {
+        fprintf(stderr, "Cannot run %s\n", cmd.c_str());
+        return EXIT_FAILURE;
+    }
+    std::string out;
+    char buf[4096];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), sim)) > 0) {
+        out.append(buf, got);
+    }
+    pclose(sim);
+
+    const struct {
+        const char *key;
+        uint64_t want;
+    } checks[] = {
+        {"Number of L1 misses:", want.misses_l1},
+        {"Number of L2 misses:", want.misses_l2},
+        {"Number of write backs:", want.write_backs},
+    };
+    bool same = true;
+    for (const auto &e : checks) {
+        int64_t got_count = find_count(out, e.key);
+        if (got_count != int64_t(e.want)) {
+            printf("%s %" PRId64 ", true LRU %" PRIu64 "\n", e.key, got_count, e.want);
+            same = false;
+        }
+    }
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
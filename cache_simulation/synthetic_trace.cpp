@@ -0,0 +1,89 @@
+/**
+ * @file synthetic_trace.cpp
+ * @brief Writes small synthetic traces for the tests
+ *
+ * synthetic_trace PATTERN N OUT writes N accesses of one pattern to OUT:
+ *   stream  sequential 8-byte steps, mostly reads
+ *   stride  a 4 KB stride over 512 pages, cycling through four blocks
+ *   random  uniform over 4 MB
+ *   mixed   a hot set of 2000 words, a stream and scattered writes
+ * The generator is seeded, so the same command always writes the same trace.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// xorshift64*, so the traces don't depend on the standard library's rand()
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random()
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+// true with probability percent / 100
+static bool chance(uint64_t percent)
+{
+    return next_random() % 100 < percent;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s stream|stride|random|mixed N OUT\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *pattern = argv[1];
+    uint64_t n = strtoull(argv[2], NULL, 10);
+    FILE *out = fopen(argv[3], "w");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot open %s for writing\n", argv[3]);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t hot[2000];
+    for (uint64_t &h : hot) {
+        h = 0x600000 + (next_random() % (1 << 20)) * 8;
+    }
+    uint64_t stream = 0x10000000;
+
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t addr;
+        char rw;
+        if (strcmp(pattern, "stream") == 0) {
+            stream += 8;
+            addr = stream;
+            rw = chance(80) ? 'R' : 'W';
+        } else if (strcmp(pattern, "stride") == 0) {
+            addr = 0x40000000 + (i % 512) * 4096 + (i / 512 % 4) * 64;
+            rw = i % 3 ? 'R' : 'W';
+        } else if (strcmp(pattern, "random") == 0) {
+            addr = (0x7fff00000000ULL + next_random() % (1 << 22)) & ~uint64_t(3);
+            rw = chance(67) ? 'R' : 'W';
+        } else if (strcmp(pattern, "mixed") == 0) {
+            uint64_t r = next_random() % 10;
+            if (r < 6) {
+                addr = hot[next_random() % 2000];
+                rw = chance(50) ? 'R' : 'W';
+            } else if (r < 8) {
+                stream += 16;
+                addr = stream;
+                rw = 'R';
+            } else {
+                addr = next_random() & 0xfffffffffff8ULL;
+                rw = 'W';
+            }
+        } else {
+            fprintf(stderr, "Unknown pattern %s\n", pattern);
+            return EXIT_FAILURE;
+        }
+        fprintf(out, "%llx %c\n", (unsigned long long)addr, rw);
+    }
+
+    return fclose(out) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,284 @@
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace_reader.hpp"
+
+static const size_t TRACE_CHUNK = 1 << 20;
+
+struct hex_table {
+    int8_t value[256];
+
+    hex_table()
+    {
+        memset(value, -1, sizeof(value));
+        for (int i = 0; i < 10; i++) {
+            value['0' + i] = int8_t(i);
+        }
+        for (int i = 0; i < 6; i++) {
+            value['a' + i] = int8_t(10 + i);
+            value['A' + i] = int8_t(10 + i);
+        }
+    }
+};
+
+static const hex_table HEX;
+
+enum chunk_state_t { CHUNK_FREE, CHUNK_READ, CHUNK_PARSED };
+
+struct trace_chunk {
+    std::vector<char> text;
+    std::vector<uint64_t> addrs;
+    std::vector<char> rws;
+    uint64_t lines;             // lines started in the chunk
+    uint64_t bad_line;          // line of the first malformed one within the chunk, 0 if none
+    const char *message;
+    chunk_state_t state;
+};
+
+static bool blank(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\v' || ch == '\f';
+}
+
+static void parse_chunk(struct trace_chunk *c)
+{
+    const char *p = c->text.data();
+    const char *end = p + c->text.size();
+    c->addrs.clear();
+    c->rws.clear();
+    c->lines = 0;
+    c->bad_line = 0;
+
+    while (p < end) {
+        c->lines++;
+        while (p < end && blank(*p)) {
+            p++;
+        }
+        if (p == end) {
+            break;
+        }
+        if (*p == '\n') {
+            p++;
+            continue;
+        }
+
+        if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && HEX.value[uint8_t(p[2])] >= 0) {
+            p += 2;
+        }
+        const char *digits = p;
+        uint64_t addr = 0;
+        int8_t v;
+        while (p < end && (v = HEX.value[uint8_t(*p)]) >= 0) {
+            addr = addr << 4 | uint64_t(v);
+            p++;
+        }
+        if (p == digits || p - digits > 16 || p == end || !blank(*p)) {
+            c->bad_line = c->lines;
+            c->message = p - digits > 16 ? "address wider than 64 bits" : "expected a hex address";
+            return;
+        }
+
+        while (p < end && blank(*p)) {
+            p++;
+        }
+        if (p == end || (*p != 'R' && *p != 'W')) {
+            c->bad_line = c->lines;
+            c->message = "expected R or W";
+            return;
+        }
+        char rw = *p++;
+        while (p < end && blank(*p)) {
+            p++;
+        }
+        if (p < end && *p != '\n') {
+            c->bad_line = c->lines;
+            c->message = "trailing characters";
+            return;
+        }
+        p += p < end;
+
+        c->addrs.push_back(addr);
+        c->rws.push_back(rw);
+    }
+}
+
+// Reads the next chunk, ending it after the last newline read and keeping
+// the partial line after it in carry. Returns false at the end of the input.
+static bool read_chunk(FILE *in, std::vector<char> &carry, std::vector<char> &text, bool *failed)
+{
+    text.swap(carry);
+    carry.clear();
+    size_t len = text.size();
+    bool eof = false;
+
+    for (;;) {
+        text.resize(len + TRACE_CHUNK);
+        size_t got = fread(text.data() + len, 1, TRACE_CHUNK, in);
+        size_t from = len;
+        len += got;
+        if (got < TRACE_CHUNK) {
+            eof = true;
+            *failed = ferror(in) != 0;
+            break;
+        }
+        if (memchr(text.data() + from, '\n', got) != NULL) {
+            break;
+        }
+    }
+    text.resize(len);
+
+    if (!eof) {
+        size_t cut = len;
+        while (text[cut - 1] != '\n') {
+            cut--;
+        }
+        carry.assign(text.begin() + long(cut), text.end());
+        text.resize(cut);
+    }
+    return len > 0;
+}
+
+/** @brief Number of parser threads to use on this machine
+ */
+unsigned trace_default_threads()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n < TRACE_MAX_THREADS ? n : TRACE_MAX_THREADS;
+}
+
+/** @brief Parses a whole text trace, handing its accesses over in order
+ *
+ *  With more than one thread, a reader thread fills a ring of chunks that
+ *  the parser threads take in turn; the caller's thread hands every parsed
+ *  chunk to the sink in order and returns the chunk to the reader. Memory
+ *  is bounded by the ring, two chunks per parser thread. With one thread
+ *  everything happens in the caller's thread.
+ *
+ *  @param in the trace, read from its current position to the end
+ *  @param threads the number of parser threads
+ *  @param sink called with the accesses of every chunk, in trace order
+ *  @param arg passed to the sink
+ *  @param err where to store the first error, if any
+ *  @return false on a malformed line or a read error; the accesses before
+ *          it have been handed to the sink
+ */
+bool trace_read(FILE *in, unsigned threads, trace_sink_t sink, void *arg, struct trace_error_t *err)
+{
+    std::vector<char> carry;
+    uint64_t base = 0;
+    bool failed = false;
+
+    if (threads <= 1) {
+        struct trace_chunk c;
+        while (read_chunk(in, carry, c.text, &failed)) {
+            parse_chunk(&c);
+            sink(c.addrs.data(), c.rws.data(), c.addrs.size(), arg);
+            if (c.bad_line) {
+                err->line = base + c.bad_line;
+                err->message = c.message;
+                return false;
+            }
+            base += c.lines;
+        }
+        if (failed) {
+            err->line = base + 1;
+            err->message = "read error";
+        }
+        return !failed;
+    }
+
+    std::vector<struct trace_chunk> ring(2 * threads);
+    for (struct trace_chunk &c : ring) {
+        c.state = CHUNK_FREE;
+    }
+    std::mutex lock;
+    std::condition_variable changed;
+    uint64_t num_read = 0;
+    uint64_t num_taken = 0;
+    bool read_done = false;
+    bool stop = false;
+
+    std::thread reader([&]() {
+        for (uint64_t seq = 0;; seq++) {
+            struct trace_chunk &c = ring[seq % ring.size()];
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&]() { return c.state == CHUNK_FREE || stop; });
+                if (stop) {
+                    break;
+                }
+            }
+            bool more = read_chunk(in, carry, c.text, &failed);
+            std::lock_guard<std::mutex> guard(lock);
+            if (!more) {
+                read_done = true;
+                changed.notify_all();
+                break;
+            }
+            c.state = CHUNK_READ;
+            num_read = seq + 1;
+            changed.notify_all();
+        }
+    });
+
+    std::vector<std::thread> parsers;
+    for (unsigned t = 0; t < threads; t++) {
+        parsers.push_back(std::thread([&]() {
+            std::unique_lock<std::mutex> guard(lock);
+            for (;;) {
+                changed.wait(guard, [&]() { return num_taken < num_read || read_done || stop; });
+                if (stop || num_taken == num_read) {
+                    break;
+                }
+                struct trace_chunk &c = ring[num_taken++ % ring.size()];
+                guard.unlock();
+                parse_chunk(&c);
+                guard.lock();
+                c.state = CHUNK_PARSED;
+                changed.notify_all();
+            }
+        }));
+    }
+
+    bool ok = true;
+    for (uint64_t seq = 0;; seq++) {
+        struct trace_chunk &c = ring[seq % ring.size()];
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return c.state == CHUNK_PARSED || (read_done && seq == num_read); });
+            if (c.state != CHUNK_PARSED) {
+                break;
+            }
+        }
+        sink(c.addrs.data(), c.rws.data(), c.addrs.size(), arg);
+        if (c.bad_line) {
+            err->line = base + c.bad_line;
+            err->message = c.message;
+            ok = false;
+            break;
+        }
+        base += c.lines;
+        std::lock_guard<std::mutex> guard(lock);
+        c.state = CHUNK_FREE;
+        changed.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+        changed.notify_all();
+    }
+    reader.join();
+    for (std::thread &t : parsers) {
+        t.join();
+    }
+    if (ok && failed) {
+        err->line = base + 1;
+        err->message = "read error";
+        ok = false;
+    }
+    return ok;
+}
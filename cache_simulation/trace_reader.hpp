@@ -0,0 +1,33 @@
+/**
+ * @file trace_reader.hpp
+ * @brief Chunked, multithreaded parser for text traces
+ *
+ * Reads a trace of "<hex address> <R|W>" lines in large chunks that end on a
+ * line boundary. Worker threads parse whole chunks while the caller simulates
+ * earlier ones, and the accesses reach the caller in trace order, one chunk
+ * at a time. Blank lines are skipped; any other line that isn't an address
+ * of up to 16 hex digits, with an optional 0x, followed by R or W stops the
+ * read and is reported with its line number.
+ */
+
+#ifndef TRACE_READER_H
+#define TRACE_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+static const unsigned TRACE_MAX_THREADS = 4; // the simulation itself is the bottleneck past this
+
+// Receives the accesses of one chunk
+typedef void (*trace_sink_t)(const uint64_t *addrs, const char *rws, size_t n, void *arg);
+
+struct trace_error_t {
+    uint64_t line;              // 1-based line of the error within what was read
+    const char *message;
+};
+
+unsigned trace_default_threads();
+bool trace_read(FILE *in, unsigned threads, trace_sink_t sink, void *arg, struct trace_error_t *err);
+
+#endif // TRACE_READER_H
@@ -2,40 +2,94 @@
 #include <cinttypes>
 #include <cstdlib>
 #include <cstring>
-#include <list>
-#include <iostream>
 
 #include "procsim.hpp"
 
 using namespace std;
 
-uint64_t ID = 0; // instruction ID start with 0
-uint64_t f, k0, k1, k2, r, g, c, sets, G;
-int64_t misprediction_ID = -1;
-bool misprediction = false;
-int32_t GHR = 0;
+static const uint64_t RESULT_RING_INIT = 1024;
 
-uint64_t sum_sq;
-
-
-Scheduling_Queue sq;
-Register_File rf;
-inst_t inst;
-list<inst_t> dq;
-list<int32_t> dq_misprediction;
-Score_Board sb;
-Result result;
-list<inst_t> fetch_buffer;
-Cache cache;
-BTB btb;
+processor_t::processor_t(inst_source_t* source)
+    : source(source), ID(0), misprediction_ID(-1), misprediction(false), GHR(0), sum_sq(0)
+{
+}
 
+template <class T>
+void processor_t::result_array(T*& a, uint64_t capacity) {
+    T* grown = new T[capacity];
+    if (a != NULL) {
+        for (uint64_t id = result.head; id < ID; id++) {
+            grown[id & (capacity - 1)] = a[result_slot(id)];
+        }
+        delete[] a;
+    }
+    a = grown;
+}
 
+// Sizes the ring for capacity records, keeping the ones in flight
+void processor_t::result_resize(uint64_t capacity) {
+    result_array(result.fetch, capacity);
+    result_array(result.dispatch, capacity);
+    result_array(result.schedule, capacity);
+    result_array(result.execute, capacity);
+    result_array(result.update, capacity);
+    result_array(result.opcode, capacity);
+    result_array(result.actual_taken, capacity);
+    result_array(result.address, capacity);
+    result_array(result.retired, capacity);
+    result.mask = capacity - 1;
+}
 
+void processor_t::timeline_flush() {
+    fwrite(timeline_buf, 1, timeline_len, timeline);
+    timeline_len = 0;
+}
 
+static char* put_u64(char* p, uint64_t x) {
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = char('0' + x % 10);
+        x /= 10;
+    } while (x != 0);
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    return p;
+}
 
+void processor_t::timeline_write(uint64_t id) {
+    uint64_t i = result_slot(id);
+    uint64_t row[6] = {id, result.fetch[i], result.dispatch[i], result.schedule[i], result.execute[i], result.update[i]};
+    if (timeline_len + sizeof(row) * 4 > TIMELINE_BUFFER) {
+        timeline_flush();
+    }
+    if (timeline_format == TIMELINE_BINARY) {
+        memcpy(timeline_buf + timeline_len, row, sizeof(row));
+        timeline_len += sizeof(row);
+        return;
+    }
+    char* p = timeline_buf + timeline_len;
+    for (int j = 1; j < 6; j++) {
+        p = put_u64(p, row[j]);
+        *p++ = j < 5 ? ' ' : '\n';
+    }
+    timeline_len = size_t(p - timeline_buf);
+}
 
-int check_sq_full();
-void sort();
+/**
+ * Marks an instruction as retired and writes out, in ID order, every record
+ * that no older instruction is holding back
+ */
+void processor_t::retire(uint64_t id) {
+    result.retired[result_slot(id)] = 1;
+    while (result.head < ID && result.retired[result_slot(result.head)] == 1) {
+        if (timeline_format != TIMELINE_NONE && result.opcode[result_slot(result.head)] != 1) {
+            timeline_write(result.head);
+        }
+        result.head++;
+    }
+}
 
 /**
  * Subroutine for initializing the processor. You many add and initialize any global or heap
@@ -43,7 +97,7 @@ void sort();
  *
  * param config Pointer to the run configuration structure
  */
-void setup_proc(proc_conf_t *config)
+void processor_t::setup_proc(proc_conf_t *config)
 {
     f = config->f;
     k0 = config->k0;
@@ -69,32 +123,28 @@ void setup_proc(proc_conf_t *config)
         cache.valid[i] = 0;
     }
 
-    result.fetch = new uint64_t[2000000];
-    result.dispatch = new uint64_t[2000000];
-    result.schedule = new uint64_t[2000000];
-    result.execute = new uint64_t[2000000];
-    result.update = new uint64_t[2000000];
-    result.opcode = new int32_t[2000000];
-    result.actual_taken = new int32_t[2000000];
-    result.address = new uint64_t[2000000];
-
-    for (int i = 0; i < 2000000; i++) {
-        result.fetch[i] = 0;
-        result.dispatch[i] = 0;
-        result.schedule[i] = 0;
-        result.execute[i] = 0;
-        result.update[i] = 0;
-        result.opcode[i] = 0;
-        result.actual_taken[i] = 100; // no meaning
-        result.address[i] = 0;
+    memset(&result, 0, sizeof(result));
+    result_resize(RESULT_RING_INIT);
+
+    timeline = config->timeline;
+    timeline_format = config->timeline_format;
+    timeline_len = 0;
+    if (timeline_format == TIMELINE_TEXT) {
+        fputs("FETCH\tDISP\tSCHED\tEXEC\tSUPDATE\n", timeline);
+    } else if (timeline_format == TIMELINE_BINARY) {
+        uint32_t header[2] = {TIMELINE_VERSION, 6};
+        fwrite(TIMELINE_MAGIC, 1, 8, timeline);
+        fwrite(header, sizeof(header), 1, timeline);
     }
 
     rf.ready = new int32_t[32];
     rf.tag = new int32_t[32];
+    rf.slot = new int32_t[32];
 
     for (int i = 0; i < 32; i++) {
         rf.ready[i] = 1;
         rf.tag[i] = -1;
+        rf.slot[i] = -1;
     }
 
     sq.op = new int32_t[r * (k0 + k1 + k2)];
@@ -106,6 +156,8 @@ void setup_proc(proc_conf_t *config)
     sq.src2_tag = new int32_t[r * (k0 + k1 + k2)];
     sq.execution_time = new int32_t[r * (k0 + k1 + k2)];
     sq.address = new int64_t[r * (k0 + k1 + k2)];
+    sq.older = new int32_t[r * (k0 + k1 + k2)];
+    sq.younger = new int32_t[r * (k0 + k1 + k2)];
 
     for (uint64_t i = 0; i < r * (k0 + k1 + k2); i++) {
         sq.op[i] = 0;
@@ -117,7 +169,18 @@ void setup_proc(proc_conf_t *config)
         sq.src2_tag[i] = -1;
         sq.execution_time[i] = -3000000;
         sq.address[i] = -1;
+        sq.older[i] = -1;
+        sq.younger[i] = -1;
+    }
+
+    sq_oldest = -1;
+    sq_youngest = -1;
+    sq_free.clear();
+    for (uint64_t i = r * (k0 + k1 + k2); i > 0; i--) {
+        sq_free.push_back(int32_t(i - 1));
     }
+    sq_ready.clear();
+    sq_waiters = new vector<int32_t>[r * (k0 + k1 + k2)];
 
     sb.k0_busy = new int32_t[k0];
     sb.k1_busy = new int32_t[k1];
@@ -141,55 +204,153 @@ void setup_proc(proc_conf_t *config)
 
 
 
-int check_sq_full() { // return -1 if full
-    for (uint64_t i = 0; i < r * (k0 + k1 + k2); i++) {
-        if (sq.dest_tag[i] == -1 && sq.execution_time[i] == -3000000) {
-            return int(i);
-        }
+int processor_t::check_sq_full() { // return -1 if full
+    return sq_free.empty() ? -1 : sq_free.back();
+}
+
+// Takes the free entry i and makes it the youngest. Dispatch is in program
+// order, so the list stays in dest_tag order without sorting.
+void processor_t::sq_link(int32_t i) {
+    sq_free.pop_back();
+    sq.older[i] = sq_youngest;
+    sq.younger[i] = -1;
+    if (sq_youngest == -1) {
+        sq_oldest = i;
+    } else {
+        sq.younger[sq_youngest] = i;
+    }
+    sq_youngest = i;
+}
+
+void processor_t::sq_unlink(int32_t i) {
+    if (sq.older[i] == -1) {
+        sq_oldest = sq.younger[i];
+    } else {
+        sq.younger[sq.older[i]] = sq.younger[i];
+    }
+    if (sq.younger[i] == -1) {
+        sq_youngest = sq.older[i];
+    } else {
+        sq.older[sq.younger[i]] = sq.older[i];
     }
-    return -1;
+    sq_free.push_back(i);
 }
 
-void sort() {
-    for (uint64_t i = 0; i < r * (k0 + k1 + k2) - 1; i++) {
-        int32_t min = sq.dest_tag[i];
-        int index = i;
-        for (uint64_t j = i + 1; j < r * (k0 + k1 + k2); j++) {
-            if (sq.dest_tag[j] < min) {
-                min = sq.dest_tag[j];
-                index = j;
+// The part of a cycle after the scheduler: the fetch buffer moves into the
+// dispatch queue, the next group is fetched and the cycle is accounted.
+// *ret becomes false once the trace is exhausted.
+void processor_t::front_end(proc_stats_t* p_stats, bool* ret) {
+    // fetch_buffer
+    while (!fetch_buffer.empty()) {
+        inst_t temp = fetch_buffer.front();
+        result.dispatch[result_slot(temp.id)] = p_stats->cycle_count;
+        fetch_buffer.pop_front();
+        dq.push_back(temp);
+
+        if (temp.opcode == 6) {
+            bool taken;
+            if (btb.smith[((temp.inst_addr >> 2) % (1 << g)) ^ GHR] >= 2) {
+                taken = true;
+            } else {
+                taken = false;
+            }
+            if (taken == temp.br_taken) {
+                dq_misprediction.push_back(0);
+                p_stats->correctly_predicted++;
+            } else {
+                dq_misprediction.push_back(1);
             }
+        } else {
+            dq_misprediction.push_back(100); // no meaning
         }
+    }
 
-        int32_t temp1 = sq.op[index];
-        int32_t temp2 = sq.dest_reg[index];
-        int32_t temp3 = sq.dest_tag[index];
-        int32_t temp4 = sq.src1_ready[index];
-        int32_t temp5 = sq.src1_tag[index];
-        int32_t temp6 = sq.src2_ready[index];
-        int32_t temp7 = sq.src2_tag[index];
-        int32_t temp8 = sq.execution_time[index];
-        int64_t temp9 = sq.address[index];
-
-        sq.op[index] = sq.op[i];
-        sq.dest_reg[index] = sq.dest_reg[i];
-        sq.dest_tag[index] = sq.dest_tag[i];
-        sq.src1_ready[index] = sq.src1_ready[i];
-        sq.src1_tag[index] = sq.src1_tag[i];
-        sq.src2_ready[index] = sq.src2_ready[i];
-        sq.src2_tag[index] = sq.src2_tag[i];
-        sq.execution_time[index] = sq.execution_time[i];
-        sq.address[index] = sq.address[i];
-
-        sq.op[i] = temp1;
-        sq.dest_reg[i] = temp2;
-        sq.dest_tag[i] = temp3;
-        sq.src1_ready[i] = temp4;
-        sq.src1_tag[i] = temp5;
-        sq.src2_ready[i] = temp6;
-        sq.src2_tag[i] = temp7;
-        sq.execution_time[i] = temp8;
-        sq.address[i] = temp9;
+    // fetch
+    for (uint64_t i = 0; i < f; i++) {
+        *ret = source->read_instruction(&inst);
+        if (*ret == false) {
+            break;
+        } else {
+
+            inst.id = ID;
+            if (ID - result.head > result.mask) {
+                result_resize(2 * (result.mask + 1));
+            }
+            result.dispatch[result_slot(inst.id)] = 0;
+            result.schedule[result_slot(inst.id)] = 0;
+            result.execute[result_slot(inst.id)] = 0;
+            result.update[result_slot(inst.id)] = 0;
+            result.actual_taken[result_slot(inst.id)] = 100; // no meaning
+            result.retired[result_slot(inst.id)] = 0;
+            result.fetch[result_slot(inst.id)] = p_stats->cycle_count;
+            result.opcode[result_slot(inst.id)] = inst.opcode;
+            result.address[result_slot(inst.id)] = inst.inst_addr;
+
+            if (inst.opcode == 6) {
+                if (inst.br_taken == true) {
+                    result.actual_taken[result_slot(inst.id)] = 1;
+                } else {
+                    result.actual_taken[result_slot(inst.id)] = 0;
+                }
+            }
+
+            ID++;
+            if (inst.opcode != 1) {
+                p_stats->instructions_retired++;
+            }
+
+            if (inst.opcode == 6) {
+                p_stats->branch_instructions++;
+            }
+            if (inst.opcode == 4) {
+                p_stats->load_instructions++;
+            }
+            if (inst.opcode == 5) {
+                p_stats->store_instructions++;
+            }
+
+            fetch_buffer.push_back(inst);
+
+        }
+    }
+
+    sum_sq += dq.size();
+    if (p_stats->max_disp_queue_size < dq.size()) {
+        p_stats->max_disp_queue_size = dq.size();
+    }
+
+    p_stats->cycle_count++;
+}
+
+// Called after a cycle in which nothing reached the end of execution, fired
+// or dispatched, with dispatch unable to resume before something completes.
+// The cycles until the next completion would then only count down the
+// execution timers, so they run just the front end.
+void processor_t::skip_idle(proc_stats_t* p_stats, bool* ret) {
+    int32_t next = -3000000;
+    for (int32_t i = sq_oldest; i != -1; i = sq.younger[i]) {
+        if (sq.execution_time[i] != -3000000 && (next == -3000000 || sq.execution_time[i] < next)) {
+            next = sq.execution_time[i];
+        }
+    }
+    if (next <= 1) {
+        return;
+    }
+
+    int32_t skip = next - 1; // the timer reaches 0 in the execute stage of the cycle after these
+    if (!*ret && fetch_buffer.empty()) {
+        sum_sq += dq.size() * uint64_t(skip);
+        p_stats->cycle_count += uint64_t(skip);
+    } else {
+        for (int32_t s = 0; s < skip; s++) {
+            front_end(p_stats, ret);
+        }
+    }
+
+    for (int32_t i = sq_oldest; i != -1; i = sq.younger[i]) {
+        if (sq.execution_time[i] != -3000000) {
+            sq.execution_time[i] -= skip;
+        }
     }
 }
 
@@ -199,29 +360,31 @@ void sort() {
  *
  * param p_stats Pointer to the statistics structure
  */
-void run_proc(proc_stats_t* p_stats)
+void processor_t::run_proc(proc_stats_t* p_stats)
 {
     bool ret = true;
     bool continue_execution = true;
 
     while (ret || continue_execution) {
+        bool idle = true; // nothing completed, fired or dispatched
 
         // execute
-        for (uint64_t i = 0; i < r * (k0 + k1 + k2); i++) {
-            if (sq.dest_tag[i] != -1) {
-                if (sq.execution_time[i] != -3000000) { // already fired
-                    sq.execution_time[i]--;
+        for (int32_t i = sq_oldest; i != -1; i = sq.younger[i]) {
+            if (sq.execution_time[i] != -3000000) { // already fired
+                sq.execution_time[i]--;
+                if (sq.execution_time[i] < 1) {
+                    idle = false;
                 }
-                if (sq.execution_time[i] == 0) {
-                    result.update[sq.dest_tag[i]] = p_stats->cycle_count;
-                    if (sq.op[i] == 4 || sq.op[i] == 5) {
-                        for (uint64_t j = 0; j < k2; j++) {
-                            if (sb.k2_busy[j] == 1 && sb.address[j] == sq.address[i]) {
-                                sb.k2_busy[j] = 0;
-                                sb.address[j] = 0;
-
-                                break;
-                            }
+            }
+            if (sq.execution_time[i] == 0) {
+                result.update[result_slot(sq.dest_tag[i])] = p_stats->cycle_count;
+                if (sq.op[i] == 4 || sq.op[i] == 5) {
+                    for (uint64_t j = 0; j < k2; j++) {
+                        if (sb.k2_busy[j] == 1 && sb.address[j] == sq.address[i]) {
+                            sb.k2_busy[j] = 0;
+                            sb.address[j] = 0;
+
+                            break;
                         }
                     }
                 }
@@ -236,155 +399,162 @@ void run_proc(proc_stats_t* p_stats)
             sb.k1_busy[i] = 0;
         }
 
-        sort();
+        // fire, oldest ready entry first
+        size_t waiting = sq_ready.size();
+        for (set<pair<int32_t, int32_t> >::iterator it = sq_ready.begin(); it != sq_ready.end();) {
+            set<pair<int32_t, int32_t> >::iterator fired = it++;
+            int32_t i = fired->second;
+
+            if (sq.op[i] == 2 || sq.op[i] == 6) { // use k0
+                for (uint64_t j = 0; j < k0; j++) {
+                    if (sb.k0_busy[j] == 0) {
+                        result.execute[result_slot(sq.dest_tag[i])] = p_stats->cycle_count;
+                        sb.k0_busy[j] = 1;
+                        sq.execution_time[i] = 1; // add/branch is 1 cycle
+                        sq_ready.erase(fired);
+                        break;
+                    }
+                }
+            } else if (sq.op[i] == 3) { // use k1
+                for (uint64_t j = 0; j < k1; j++) {
+                    if (sb.k1_busy[j] == 0) {
+                        result.execute[result_slot(sq.dest_tag[i])] = p_stats->cycle_count;
+                        sb.k1_busy[j] = 1;
+                        sq.execution_time[i] = 3; // mul is 3 cycles
+                        sq_ready.erase(fired);
+                        break;
+                    }
+                }
+            } else if (sq.op[i] == 4) { // lw, use k2
 
-        // fire
-        for (uint64_t i = 0; i < r * (k0 + k1 + k2); i++) {
-            if (sq.dest_tag[i] != -1) { // RS is not empty
-                if (sq.src1_ready[i] == 1 && sq.src2_ready[i] == 1 && sq.execution_time[i] == -3000000) { // both sources are ready
 
-                    if (sq.op[i] == 2 || sq.op[i] == 6) { // use k0
-                        for (uint64_t j = 0; j < k0; j++) {
-                            if (sb.k0_busy[j] == 0) {
-                                result.execute[sq.dest_tag[i]] = p_stats->cycle_count;
-                                sb.k0_busy[j] = 1;
-                                sq.execution_time[i] = 1; // add/branch is 1 cycle
-                                break;
-                            }
-                        }
-                    } else if (sq.op[i] == 3) { // use k1
-                        for (uint64_t j = 0; j < k1; j++) {
-                            if (sb.k1_busy[j] == 0) {
-                                result.execute[sq.dest_tag[i]] = p_stats->cycle_count;
-                                sb.k1_busy[j] = 1;
-                                sq.execution_time[i] = 3; // mul is 3 cycles
-                                break;
-                            }
-                        }
-                    } else if (sq.op[i] == 4) { // lw, use k2
+                uint64_t TAG = (sq.address[i] >> c);
+                uint64_t INDEX = (sq.address[i] >> 6) & ((1 << (c - 6)) - 1);
 
+                bool flag = false;
+                for (uint64_t j = 0; j < k2; j++) {
+                    uint64_t index = (sb.address[j] >> 6) & ((1 << (c - 6)) - 1);
+                    if (sb.k2_busy[j] == 1 && INDEX == index) {
+                        flag = true;
+                        break;
+                    }
+                }
 
-                        uint64_t TAG = (sq.address[i] >> c);
-                        uint64_t INDEX = (sq.address[i] >> 6) & ((1 << (c - 6)) - 1);
+                if (flag == true) {
+                    continue;
+                }
 
-                        bool flag = false;
-                        for (uint64_t j = 0; j < k2; j++) {
-                            uint64_t index = (sb.address[j] >> 6) & ((1 << (c - 6)) - 1);
-                            if (sb.k2_busy[j] == 1 && INDEX == index) {
-                                flag = true;
-                                break;
-                            }
-                        }
+                bool flag2 = false;
+                for (int32_t k = sq_oldest; k != i; k = sq.younger[k]) { // older entries
+                    if (sq.address[k] == sq.address[i] && sq.op[k] == 5) {
+                        flag2 = true;
+                        break;
+                    }
+                }
 
-                        if (flag == true) {
-                            continue;
-                        }
+                if (flag2 == true) {
+                    continue;
+                }
 
-                        bool flag2 = false;
-                        for (uint64_t k = 0; k < i; k++) {
-                            if (sq.address[k] == sq.address[i] && sq.op[k] == 5) {
-                                flag2 = true;
-                                break;
-                            }
+                for (uint64_t j = 0; j < k2; j++) {
+                    if (sb.k2_busy[j] == 0) {
+                        bool cache_miss;
+                        if (cache.valid[INDEX] == 1 && cache.tag[INDEX] == TAG) { // cache hit
+                            cache_miss = false;
+                        } else { // cache miss
+                            cache_miss = true;
+                            p_stats->cache_misses++;
+                            cache.valid[INDEX] = 1;
+                            cache.tag[INDEX] = TAG;
                         }
 
-                        if (flag2 == true) {
-                            continue;
-                        }
+                        result.execute[result_slot(sq.dest_tag[i])] = p_stats->cycle_count;
+                        sb.k2_busy[j] = 1;
+                        sb.address[j] = sq.address[i]; // fire
 
-                        for (uint64_t j = 0; j < k2; j++) {
-                            if (sb.k2_busy[j] == 0) {
-                                bool cache_miss;
-                                if (cache.valid[INDEX] == 1 && cache.tag[INDEX] == TAG) { // cache hit
-                                    cache_miss = false;
-                                } else { // cache miss
-                                    cache_miss = true;
-                                    p_stats->cache_misses++;
-                                    cache.valid[INDEX] = 1;
-                                    cache.tag[INDEX] = TAG;
-                                }
-
-                                result.execute[sq.dest_tag[i]] = p_stats->cycle_count;
-                                sb.k2_busy[j] = 1;
-                                sb.address[j] = sq.address[i]; // fire
-
-                                if (cache_miss) {
-                                    sq.execution_time[i] = 10; // cache miss is 10 cycles
-                                } else {
-                                    sq.execution_time[i] = 1;
-                                }
-                                break;
-                            }
+                        sq_ready.erase(fired);
+
+                        if (cache_miss) {
+                            sq.execution_time[i] = 10; // cache miss is 10 cycles
+                        } else {
+                            sq.execution_time[i] = 1;
                         }
+                        break;
+                    }
+                }
 
 
-                    } else if (sq.op[i] == 5) { // sw, use k2
+            } else if (sq.op[i] == 5) { // sw, use k2
 
 
 
-                      uint64_t TAG = (sq.address[i] >> c);
-                      uint64_t INDEX = (sq.address[i] >> 6) & ((1 << (c - 6)) - 1);
+              uint64_t TAG = (sq.address[i] >> c);
+              uint64_t INDEX = (sq.address[i] >> 6) & ((1 << (c - 6)) - 1);
 
-                      bool flag = false;
-                      for (uint64_t j = 0; j < k2; j++) {
-                          uint64_t index = (sb.address[j] >> 6) & ((1 << (c - 6)) - 1);
-                          if (sb.k2_busy[j] == 1 && INDEX == index) {
-                              flag = true;
-                              break;
-                          }
-                      }
+              bool flag = false;
+              for (uint64_t j = 0; j < k2; j++) {
+                  uint64_t index = (sb.address[j] >> 6) & ((1 << (c - 6)) - 1);
+                  if (sb.k2_busy[j] == 1 && INDEX == index) {
+                      flag = true;
+                      break;
+                  }
+              }
 
-                      if (flag == true) {
-                          continue;
-                      }
+              if (flag == true) {
+                  continue;
+              }
 
-                      bool flag2 = false;
-                      for (uint64_t k = 0; k < i; k++) {
-                          if (sq.address[k] == sq.address[i] && (sq.op[k] == 5 || sq.op[k] == 4)) {
-                              flag2 = true;
-                              break;
-                          }
-                      }
+              bool flag2 = false;
+              for (int32_t k = sq_oldest; k != i; k = sq.younger[k]) { // older entries
+                  if (sq.address[k] == sq.address[i] && (sq.op[k] == 5 || sq.op[k] == 4)) {
+                      flag2 = true;
+                      break;
+                  }
+              }
+
+              if (flag2 == true) {
+                  continue;
+              }
 
-                      if (flag2 == true) {
-                          continue;
+              for (uint64_t j = 0; j < k2; j++) {
+                  if (sb.k2_busy[j] == 0) {
+                      bool cache_miss;
+                      if (cache.valid[INDEX] == 1 && cache.tag[INDEX] == TAG) { // cache hit
+                          cache_miss = false;
+                      } else { // cache miss
+                          cache_miss = true;
+                          p_stats->cache_misses++;
+                          cache.valid[INDEX] = 1;
+                          cache.tag[INDEX] = TAG;
                       }
 
-                      for (uint64_t j = 0; j < k2; j++) {
-                          if (sb.k2_busy[j] == 0) {
-                              bool cache_miss;
-                              if (cache.valid[INDEX] == 1 && cache.tag[INDEX] == TAG) { // cache hit
-                                  cache_miss = false;
-                              } else { // cache miss
-                                  cache_miss = true;
-                                  p_stats->cache_misses++;
-                                  cache.valid[INDEX] = 1;
-                                  cache.tag[INDEX] = TAG;
-                              }
-
-                              result.execute[sq.dest_tag[i]] = p_stats->cycle_count;
-                              sb.k2_busy[j] = 1;
-                              sb.address[j] = sq.address[i]; // fire
-
-                              if (cache_miss) {
-                                  sq.execution_time[i] = 10; // cache miss is 10 cycles
-                              } else {
-                                  sq.execution_time[i] = 1;
-                              }
-                              break;
-                          }
+                      result.execute[result_slot(sq.dest_tag[i])] = p_stats->cycle_count;
+                      sb.k2_busy[j] = 1;
+                      sb.address[j] = sq.address[i]; // fire
+
+                      sq_ready.erase(fired);
+
+                      if (cache_miss) {
+                          sq.execution_time[i] = 10; // cache miss is 10 cycles
+                      } else {
+                          sq.execution_time[i] = 1;
                       }
+                      break;
+                  }
+              }
 
 
 
 
-                    }
-                }
             }
         }
 
 
 
+        if (sq_ready.size() != waiting) {
+            idle = false;
+        }
+
         // disptach to schedule
         if (misprediction == false) { // if predict correctly
             while (!dq.empty()) {
@@ -394,14 +564,16 @@ void run_proc(proc_stats_t* p_stats)
                 } else {
                     inst_t temp = dq.front();
                     dq.pop_front();
+                    idle = false;
                     int32_t TEMP = dq_misprediction.front();
                     dq_misprediction.pop_front();
 
                     if (temp.opcode == 1) {
+                        retire(temp.id);
                         continue;
                     }
 
-                    result.schedule[temp.id] = p_stats->cycle_count;
+                    result.schedule[result_slot(temp.id)] = p_stats->cycle_count;
 
                     sq.op[return_value] = temp.opcode;
                     sq.dest_reg[return_value] = temp.dest_reg;
@@ -415,6 +587,7 @@ void run_proc(proc_stats_t* p_stats)
                         } else {
                             sq.src1_ready[return_value] = 0;
                             sq.src1_tag[return_value] = rf.tag[temp.src_reg[0]];
+                            sq_waiters[rf.slot[temp.src_reg[0]]].push_back(return_value);
                         }
                     }
 
@@ -426,6 +599,9 @@ void run_proc(proc_stats_t* p_stats)
                         } else {
                             sq.src2_ready[return_value] = 0;
                             sq.src2_tag[return_value] = rf.tag[temp.src_reg[1]];
+                            if (sq.src1_ready[return_value] == 1 || sq.src1_tag[return_value] != sq.src2_tag[return_value]) {
+                                sq_waiters[rf.slot[temp.src_reg[1]]].push_back(return_value);
+                            }
                         }
                     }
 
@@ -433,9 +609,14 @@ void run_proc(proc_stats_t* p_stats)
                     if (temp.dest_reg != -1) {
                         rf.tag[temp.dest_reg] = temp.id;
                         rf.ready[temp.dest_reg] = 0;
+                        rf.slot[temp.dest_reg] = return_value;
                     }
 
                     sq.address[return_value] = temp.ld_st_addr;
+                    sq_link(return_value);
+                    if (sq.src1_ready[return_value] == 1 && sq.src2_ready[return_value] == 1) {
+                        sq_ready.insert(make_pair(sq.dest_tag[return_value], return_value));
+                    }
                     if (temp.opcode == 6) {
                         if (TEMP == 1) { // mispredict
                             misprediction = true;
@@ -450,8 +631,9 @@ void run_proc(proc_stats_t* p_stats)
 
 
 
-        for (uint64_t i = 0; i < r * (k0 + k1 + k2); i++) {
-            if (sq.dest_tag[i] != -1 && sq.execution_time[i] == 0) {
+        for (int32_t i = sq_oldest, next; i != -1; i = next) {
+            next = sq.younger[i];
+            if (sq.execution_time[i] == 0) {
 
                 if (misprediction_ID == int64_t(sq.dest_tag[i]) && misprediction == true) {
                     misprediction = false;
@@ -467,52 +649,54 @@ void run_proc(proc_stats_t* p_stats)
                 if (sq.dest_tag[i] == rf.tag[sq.dest_reg[i]]) {
                     rf.ready[sq.dest_reg[i]] = 1;
                 }
-                for (uint64_t j = 0; j < r * (k0 + k1 + k2); j++) {
+                for (size_t w = 0; w < sq_waiters[i].size(); w++) {
+                    int32_t j = sq_waiters[i][w];
                     if (!sq.src1_ready[j] && sq.src1_tag[j] == sq.dest_tag[i]) {
                         sq.src1_ready[j] = 1;
                     }
                     if (!sq.src2_ready[j] && sq.src2_tag[j] == sq.dest_tag[i]) {
                         sq.src2_ready[j] = 1;
                     }
+                    if (sq.src1_ready[j] == 1 && sq.src2_ready[j] == 1) {
+                        sq_ready.insert(make_pair(sq.dest_tag[j], j));
+                    }
                 }
+                sq_waiters[i].clear();
 
             }
 
-            if (sq.dest_tag[i] != -1 && sq.execution_time[i] == -1) {
+            if (sq.execution_time[i] == -1) {
 
 
               if (sq.op[i] == 6) {
 
-                  if (result.actual_taken[sq.dest_tag[i]] == 1) { // actually taken
-                      if (btb.smith[((result.address[sq.dest_tag[i]] >> 2) % (1 << g)) ^ GHR] != 3) {
-                          btb.smith[((result.address[sq.dest_tag[i]] >> 2) % (1 << g)) ^ GHR]++;
+                  if (result.actual_taken[result_slot(sq.dest_tag[i])] == 1) { // actually taken
+                      if (btb.smith[((result.address[result_slot(sq.dest_tag[i])] >> 2) % (1 << g)) ^ GHR] != 3) {
+                          btb.smith[((result.address[result_slot(sq.dest_tag[i])] >> 2) % (1 << g)) ^ GHR]++;
                       }
                   } else { // actually not taken
-                      if (btb.smith[((result.address[sq.dest_tag[i]] >> 2) % (1 << g)) ^ GHR] != 0) {
-                          btb.smith[((result.address[sq.dest_tag[i]] >> 2) % (1 << g)) ^ GHR]--;
+                      if (btb.smith[((result.address[result_slot(sq.dest_tag[i])] >> 2) % (1 << g)) ^ GHR] != 0) {
+                          btb.smith[((result.address[result_slot(sq.dest_tag[i])] >> 2) % (1 << g)) ^ GHR]--;
                       }
                   }
 
                   int32_t NNN = (1 << int32_t(g)) - 1;
-                  if (result.actual_taken[sq.dest_tag[i]] == 1) { // actually taken
+                  if (result.actual_taken[result_slot(sq.dest_tag[i])] == 1) { // actually taken
                       GHR = ((GHR << 1) + 1) & NNN;
                   } else { // actually not taken
                       GHR = (GHR << 1) & NNN;
                   }
               }
 
+                retire(sq.dest_tag[i]);
                 sq.dest_tag[i] = -1;
                 sq.execution_time[i] = -3000000;
+                sq_unlink(i);
             }
         }
 
 
-        bool FLAGG = true;
-        for (uint64_t i = 0; i < r * (k0 + k1 + k2); i++) {
-            if (sq.dest_tag[i] != -1 || sq.execution_time[i] != -3000000) { // not retired
-                FLAGG = false;
-            }
-        }
+        bool FLAGG = sq_oldest == -1; // all retired
 
         if (FLAGG == true) { // all retired
             continue_execution = false;
@@ -531,77 +715,11 @@ void run_proc(proc_stats_t* p_stats)
 
 
 
-        // fetch_buffer
-        while (!fetch_buffer.empty()) {
-            inst_t temp = fetch_buffer.front();
-            result.dispatch[temp.id] = p_stats->cycle_count;
-            fetch_buffer.pop_front();
-            dq.push_back(temp);
-
-            if (temp.opcode == 6) {
-                bool taken;
-                if (btb.smith[((temp.inst_addr >> 2) % (1 << g)) ^ GHR] >= 2) {
-                    taken = true;
-                } else {
-                    taken = false;
-                }
-                if (taken == temp.br_taken) {
-                    dq_misprediction.push_back(0);
-                    p_stats->correctly_predicted++;
-                } else {
-                    dq_misprediction.push_back(1);
-                }
-            } else {
-                dq_misprediction.push_back(100); // no meaning
-            }
-        }
-
-        // fetch
-        for (uint64_t i = 0; i < f; i++) {
-            ret = read_instruction(&inst);
-            if (ret == false) {
-                break;
-            } else {
-
-                inst.id = ID;
-                result.fetch[inst.id] = p_stats->cycle_count;
-                result.opcode[inst.id] = inst.opcode;
-                result.address[inst.id] = inst.inst_addr;
-
-                if (inst.opcode == 6) {
-                    if (inst.br_taken == true) {
-                        result.actual_taken[inst.id] = 1;
-                    } else {
-                        result.actual_taken[inst.id] = 0;
-                    }
-                }
-
-                ID++;
-                if (inst.opcode != 1) {
-                    p_stats->instructions_retired++;
-                }
-
-                if (inst.opcode == 6) {
-                    p_stats->branch_instructions++;
-                }
-                if (inst.opcode == 4) {
-                    p_stats->load_instructions++;
-                }
-                if (inst.opcode == 5) {
-                    p_stats->store_instructions++;
-                }
-
-                fetch_buffer.push_back(inst);
-
-            }
-        }
+        front_end(p_stats, &ret);
 
-        sum_sq += dq.size();
-        if (p_stats->max_disp_queue_size < dq.size()) {
-            p_stats->max_disp_queue_size = dq.size();
+        if (idle && sq_oldest != -1 && (misprediction || sq_free.empty() || (dq.empty() && fetch_buffer.empty() && !ret))) {
+            skip_idle(p_stats, &ret);
         }
-
-        p_stats->cycle_count++;
     }
 
     p_stats->cycle_count--;
@@ -615,13 +733,18 @@ void run_proc(proc_stats_t* p_stats)
  *
  * param p_stats Pointer to the statistics structure
  */
-void complete_proc(proc_stats_t *p_stats)
+void processor_t::complete_proc(proc_stats_t *p_stats)
 {
-    cout << "FETCH	DISP	SCHED	EXEC	SUPDATE" << endl;
-    for (int i = 0; i < 2000000; i++) {
-        if (result.opcode[i] != 1) {
-            cout << result.fetch[i] << " " << result.dispatch[i] << " " << result.schedule[i] << " " << result.execute[i] << " " << result.update[i] << endl;
+    if (timeline_format != TIMELINE_NONE) {
+        // the run ends once the RS drains, so instructions still in the
+        // dispatch queue never retire; their rows are written as they are
+        for (; result.head < ID; result.head++) {
+            if (result.opcode[result_slot(result.head)] != 1) {
+                timeline_write(result.head);
+            }
         }
+        timeline_flush();
+        fflush(timeline);
     }
     p_stats->cache_miss_rate = ((double) p_stats->cache_misses) / (p_stats->load_instructions + p_stats->store_instructions);
     p_stats->average_instructions_retired = ((double) p_stats->instructions_retired) / p_stats->cycle_count;
@@ -641,6 +764,7 @@ void complete_proc(proc_stats_t *p_stats)
     delete[] result.opcode;
     delete[] result.actual_taken;
     delete[] result.address;
+    delete[] result.retired;
 
     delete[] sq.op;
     delete[] sq.dest_reg;
@@ -651,9 +775,13 @@ void complete_proc(proc_stats_t *p_stats)
     delete[] sq.src2_tag;
     delete[] sq.execution_time;
     delete[] sq.address;
+    delete[] sq.older;
+    delete[] sq.younger;
 
     delete[] rf.ready;
     delete[] rf.tag;
+    delete[] rf.slot;
+    delete[] sq_waiters;
 
     delete[] sb.k0_busy;
     delete[] sb.k1_busy;
@@ -3,6 +3,10 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <list>
+#include <set>
+#include <utility>
+#include <vector>
 
 // Default structure
 #define DEFAULT_K0 3
@@ -22,6 +26,9 @@ typedef struct BTB {
     int32_t* smith;
 } BTB;
 
+// Ring of the records of in-flight instructions, indexed by ID & mask. It
+// doubles when more instructions are in flight than it holds, and records
+// leave it in ID order once their instruction has retired.
 typedef struct Result {
     uint64_t* fetch;
     uint64_t* dispatch;
@@ -31,6 +38,9 @@ typedef struct Result {
     int32_t* opcode;
     int32_t* actual_taken;
     uint64_t* address;
+    int32_t* retired;
+    uint64_t mask;          // capacity - 1, the capacity is a power of two
+    uint64_t head;          // oldest ID still in the ring
 } Result;
 
 typedef struct Scheduling_Queue {
@@ -43,11 +53,14 @@ typedef struct Scheduling_Queue {
     int32_t* src2_tag;
     int32_t* execution_time;
     int64_t* address;
+    int32_t* older;         // neighbours in age order, -1 at either end
+    int32_t* younger;
 } Scheduling_Queue;
 
 typedef struct Register_File {
     int32_t* ready;
     int32_t* tag;
+    int32_t* slot;          // sq entry of the instruction producing tag
 } Register_File;
 
 typedef struct Score_Board {
@@ -67,6 +80,16 @@ typedef enum {
     OP_BR = 6
 } opcode_t;
 
+// Per-instruction timeline output
+typedef enum {
+    TIMELINE_NONE = 0,
+    TIMELINE_TEXT = 1,      // "FETCH DISP SCHED EXEC SUPDATE" rows
+    TIMELINE_BINARY = 2     // header, then id and the five cycles as 64-bit words
+} timeline_t;
+
+#define TIMELINE_MAGIC "PSIMTL\0\0"
+#define TIMELINE_VERSION 1
+
 // Configuration struct
 typedef struct configuration {
     uint64_t f;     // Dispatch rate
@@ -76,6 +99,8 @@ typedef struct configuration {
     uint64_t r;     // Number of reservation stations per FU type
     uint64_t g;     // log2(Number of entries in BTB)
     uint64_t c;     // log2(Size of data cache in bytes)
+    FILE* timeline; // where retired instructions are written
+    timeline_t timeline_format;
 } proc_conf_t;
 
 typedef struct instruction {
@@ -111,10 +136,76 @@ typedef struct statistics {
 
 } proc_stats_t;
 
-bool read_instruction(inst_t* p_inst);
-
-void setup_proc(proc_conf_t *config);
-void run_proc(proc_stats_t *stats);
-void complete_proc(proc_stats_t *stats);
+// Where a processor fetches its instructions from
+class inst_source_t {
+public:
+    virtual ~inst_source_t() {}
+
+    // Populates the next instruction; returns false at the end of the trace
+    virtual bool read_instruction(inst_t* p_inst) = 0;
+};
+
+// One simulated processor. All of its state lives in the object, so separate
+// processors can run on separate threads.
+class processor_t {
+public:
+    explicit processor_t(inst_source_t* source);
+
+    void setup_proc(proc_conf_t *config);
+    void run_proc(proc_stats_t *stats);
+    void complete_proc(proc_stats_t *stats);
+
+private:
+    static const size_t TIMELINE_BUFFER = 1 << 16;
+
+    inst_source_t* source;
+
+    uint64_t ID; // instruction ID start with 0
+    uint64_t f, k0, k1, k2, r, g, c, sets, G;
+    int64_t misprediction_ID;
+    bool misprediction;
+    int32_t GHR;
+
+    uint64_t sum_sq;
+
+    Scheduling_Queue sq;
+    Register_File rf;
+    inst_t inst;
+    std::list<inst_t> dq;
+    std::list<int32_t> dq_misprediction;
+    Score_Board sb;
+
+    // Occupied entries of sq, oldest first, linked through sq.older/sq.younger,
+    // the free ones, and the entries whose sources are ready but that haven't
+    // fired yet, keyed by (dest_tag, entry) so they iterate oldest first
+    int32_t sq_oldest;
+    int32_t sq_youngest;
+    std::vector<int32_t> sq_free;
+    std::set<std::pair<int32_t, int32_t> > sq_ready;
+    std::vector<int32_t>* sq_waiters; // entries with a source waiting on each entry's dest_tag
+    Result result;
+    std::list<inst_t> fetch_buffer;
+    Cache cache;
+    BTB btb;
+
+    FILE* timeline;
+    timeline_t timeline_format;
+    char timeline_buf[TIMELINE_BUFFER];
+    size_t timeline_len;
+
+    uint64_t result_slot(uint64_t id) const { return id & result.mask; }
+    template <class T> void result_array(T*& a, uint64_t capacity);
+    void result_resize(uint64_t capacity);
+    void timeline_flush();
+    void timeline_write(uint64_t id);
+    void retire(uint64_t id);
+
+    int check_sq_full();
+    void sq_link(int32_t i);
+    void sq_unlink(int32_t i);
+
+    void front_end(proc_stats_t* p_stats, bool* ret);
+    void skip_idle(proc_stats_t* p_stats, bool* ret);
+};
 
 #endif // PROCSIM_HPP
@@ -2,13 +2,15 @@
 #include <cinttypes>
 #include <cstdlib>
 #include <cstring>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #include <getopt.h>
 #include <unistd.h>
 
 #include "procsim.hpp"
-
-FILE* inFile = stdin;
+#include "trace.hpp"
 
 // Print help message and exit
 static void print_help_and_exit(void)
@@ -22,6 +24,14 @@ static void print_help_and_exit(void)
     printf("  -g G\t\tlog2 number of entries in BTB\n");
     printf("  -c C\t\tlog2 number of bytes in data cache\n");
     printf("  -i traces/file.trace\n");
+    printf("\t\tText or binary; a binary trace is recognized by its header\n");
+    printf("  -D\t\tDecode the trace on the simulator thread instead of a thread of its own\n");
+    printf("  -b FILE\tConvert the text trace to the binary format in FILE and exit\n");
+    printf("  -t FILE\tWrite the per-instruction timeline to FILE instead of stdout\n");
+    printf("  -T FMT\t\tTimeline format: text (default), binary or none\n");
+    printf("  -s FILE\tSweep: run every configuration in FILE, one per line as options\n");
+    printf("\t\tfrom -f -k -l -m -r -g -c over the others, and print a CSV row for each\n");
+    printf("  -j N\t\tSimulate N configurations of a sweep at once (default: all cores)\n");
     printf("  -h\t\tThis helpful output\n");
     exit(EXIT_SUCCESS);
 }
@@ -58,71 +68,190 @@ static void print_statistics(proc_stats_t* stats) {
     printf("Final Cycle count:              %lu\n", stats->cycle_count);
 }
 
-/* Function to read instruction from the input trace. Populates the inst struct
- *
- * returns true if an instruction was read successfully. Returns false at end of trace
- *
- */
-bool read_instruction(inst_t* inst)
+// Sets one of the processor parameters; returns false if opt isn't one
+static bool set_parameter(proc_conf_t* conf, int opt, const char* arg)
 {
-    int ret;
-
-    if (inst == NULL) {
-        fprintf(stderr, "Fetch requires a valid pointer to populate\n");
+    switch(opt) {
+    case 'f':
+        conf->f = atoi(arg);
+        break;
+    case 'k':
+        conf->k0 = atoi(arg);
+        break;
+    case 'l':
+        conf->k1 = atoi(arg);
+        break;
+    case 'm':
+        conf->k2 = atoi(arg);
+        break;
+    case 'r':
+        conf->r = atoi(arg);
+        break;
+    case 'g':
+        conf->g = atoi(arg);
+        break;
+    case 'c':
+        conf->c = atoi(arg);
+        break;
+    default:
         return false;
     }
+    return true;
+}
 
-    // Don't modify this line. Instruction fetch might break otherwise!
-    ret = fscanf(inFile, "%" PRIx64 " %d %d %d %d %" PRIx64 " %" PRIx64 " %d\n", &inst->inst_addr, &inst->opcode, &inst->dest_reg,
-                    &inst->src_reg[0], &inst->src_reg[1], &inst->ld_st_addr, &inst->br_target, (int *) &inst->br_taken);
+// Reads the configurations of a sweep, each line overriding base with
+// options like "-r 4 -m 3". Blank lines and lines starting with # are skipped.
+static bool read_sweep(const char* path, const proc_conf_t* base, std::vector<proc_conf_t>* configs)
+{
+    FILE* in = fopen(path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "Failed to open %s for reading\n", path);
+        return false;
+    }
 
-    if (ret != 8) { // Check if something went really wrong
-        if (!feof(inFile)) { // Check if end of file has been reached
-            fprintf(stderr, "Something went wrong and we could not parse the instruction\n");
+    char line[1024];
+    int line_no = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), in) != NULL) {
+        line_no++;
+        proc_conf_t conf = *base;
+        bool empty = true;
+        for (char* opt = strtok(line, " \t\r\n"); opt != NULL; opt = strtok(NULL, " \t\r\n")) {
+            if (empty && opt[0] == '#') {
+                break;
+            }
+            empty = false;
+            char* arg = strtok(NULL, " \t\r\n");
+            if (opt[0] != '-' || strlen(opt) != 2 || arg == NULL || !set_parameter(&conf, opt[1], arg)) {
+                fprintf(stderr, "%s:%d: expected options from -f -k -l -m -r -g -c with a value\n", path, line_no);
+                ok = false;
+                break;
+            }
+        }
+        if (ok && !empty) {
+            configs->push_back(conf);
         }
-        return false;
     }
+    fclose(in);
+    return ok;
+}
 
-    return true;
+/**
+ * Simulates every configuration on a trace parsed once into memory. Threads
+ * take the next configuration from a shared counter as they finish one, and
+ * the rows are printed in the order of the configurations.
+ */
+static void run_sweep(inst_source_t* in, const std::vector<proc_conf_t>& configs, unsigned jobs)
+{
+    std::vector<inst_t> trace;
+    inst_t inst;
+    while (in->read_instruction(&inst)) {
+        trace.push_back(inst);
+    }
+
+    std::vector<proc_stats_t> stats(configs.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < jobs; t++) {
+        workers.push_back(std::thread([&]() {
+            for (size_t i = next++; i < configs.size(); i = next++) {
+                proc_conf_t conf = configs[i];
+                conf.timeline = NULL;
+                conf.timeline_format = TIMELINE_NONE;
+
+                memory_source_t source(&trace);
+                processor_t* proc = new processor_t(&source);
+                memset(&stats[i], 0, sizeof(proc_stats_t));
+                proc->setup_proc(&conf);
+                proc->run_proc(&stats[i]);
+                proc->complete_proc(&stats[i]);
+                delete proc;
+            }
+        }));
+    }
+    for (std::thread& w : workers) {
+        w.join();
+    }
+
+    printf("f,k0,k1,k2,r,g,c,instructions_retired,branch_instructions,correctly_predicted,"
+           "branch_prediction_accuracy,load_instructions,store_instructions,cache_misses,cache_miss_rate,"
+           "average_disp_queue_size,max_disp_queue_size,average_instructions_retired,cycle_count\n");
+    for (size_t i = 0; i < configs.size(); i++) {
+        const proc_conf_t* conf = &configs[i];
+        const proc_stats_t* st = &stats[i];
+        printf("%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",",
+               conf->f, conf->k0, conf->k1, conf->k2, conf->r, conf->g, conf->c);
+        printf("%lu,%lu,%lu,%f,%lu,%lu,%lu,%f,%f,%lu,%f,%lu\n", st->instructions_retired, st->branch_instructions,
+               st->correctly_predicted, st->branch_prediction_accuracy, st->load_instructions, st->store_instructions,
+               st->cache_misses, st->cache_miss_rate, st->average_disp_queue_size, st->max_disp_queue_size,
+               st->average_instructions_retired, st->cycle_count);
+    }
 }
 
 int main(int argc, char* argv[]) {
     int opt;
+    FILE* inFile = stdin;
+    const char* sweep = NULL;
+    const char* convert = NULL;
+    bool async = true;
+    unsigned jobs = std::thread::hardware_concurrency();
 
     // Default configuration -- don't change
     proc_conf_t default_conf = {.f = DEFAULT_F, .k0 = DEFAULT_K0, .k1 = DEFAULT_K1, .k2 = DEFAULT_K2,
-                            .r = DEFAULT_R, .g = DEFAULT_G, .c = DEFAULT_C};
+                            .r = DEFAULT_R, .g = DEFAULT_G, .c = DEFAULT_C,
+                            .timeline = stdout, .timeline_format = TIMELINE_TEXT};
 
-    while(-1 != (opt = getopt(argc, argv, "f:k:l:m:r:g:c:i:h"))) {
+    while(-1 != (opt = getopt(argc, argv, "f:k:l:m:r:g:c:i:Db:t:T:s:j:h"))) {
         switch(opt) {
         case 'f':
-            default_conf.f = atoi(optarg);
-            break;
         case 'k':
-            default_conf.k0 = atoi(optarg);
-            break;
         case 'l':
-            default_conf.k1 = atoi(optarg);
-            break;
         case 'm':
-            default_conf.k2 = atoi(optarg);
-            break;
         case 'r':
-            default_conf.r = atoi(optarg);
-            break;
         case 'g':
-            default_conf.g = atoi(optarg);
-            break;
         case 'c':
-            default_conf.c = atoi(optarg);
+            set_parameter(&default_conf, opt, optarg);
             break;
         case 'i':
-            inFile = fopen(optarg, "r");
+            inFile = fopen(optarg, "rb");
             if (inFile == NULL) {
                 fprintf(stderr, "Failed to open %s for reading\n", optarg);
                 print_help_and_exit();
             }
             break;
+        case 't':
+            default_conf.timeline = fopen(optarg, "wb");
+            if (default_conf.timeline == NULL) {
+                fprintf(stderr, "Failed to open %s for writing\n", optarg);
+                print_help_and_exit();
+            }
+            break;
+        case 'T':
+            if (strcmp(optarg, "text") == 0) {
+                default_conf.timeline_format = TIMELINE_TEXT;
+            } else if (strcmp(optarg, "binary") == 0) {
+                default_conf.timeline_format = TIMELINE_BINARY;
+            } else if (strcmp(optarg, "none") == 0) {
+                default_conf.timeline_format = TIMELINE_NONE;
+            } else {
+                print_help_and_exit();
+            }
+            break;
+        case 'D':
+            async = false;
+            break;
+        case 'b':
+            convert = optarg;
+            break;
+        case 's':
+            sweep = optarg;
+            break;
+        case 'j':
+            if (atoi(optarg) <= 0) {
+                print_help_and_exit();
+            }
+            jobs = unsigned(atoi(optarg));
+            break;
         case 'h':
         default:
             print_help_and_exit();
@@ -130,18 +259,56 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (convert != NULL) {
+        FILE* out = fopen(convert, "wb");
+        if (out == NULL) {
+            fprintf(stderr, "Failed to open %s for writing\n", convert);
+            return EXIT_FAILURE;
+        }
+        bool ok = trace_convert(inFile, out);
+        fclose(out);
+        fclose(inFile);
+        return ok ? 0 : EXIT_FAILURE;
+    }
+
+    inst_source_t* source = trace_open(inFile);
+    if (source == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    if (sweep != NULL) {
+        std::vector<proc_conf_t> configs;
+        if (!read_sweep(sweep, &default_conf, &configs)) {
+            return EXIT_FAILURE;
+        }
+        run_sweep(source, configs, jobs == 0 ? 1 : jobs);
+        delete source;
+        fclose(inFile);
+        return 0;
+    }
+
     print_config(&default_conf); // Print run configuration
 
-    setup_proc(&default_conf); // Setup the processor
+    if (async) {
+        source = new async_source_t(source);
+    }
+    processor_t* proc = new processor_t(source);
+
+    proc->setup_proc(&default_conf); // Setup the processor
 
     proc_stats_t stats;
     memset(&stats, 0, sizeof(proc_stats_t));
 
-    run_proc(&stats); // Run the processor
+    proc->run_proc(&stats); // Run the processor
 
-    complete_proc(&stats); // Finalize statistics and perform cleanup
+    proc->complete_proc(&stats); // Finalize statistics and perform cleanup
+    delete proc;
+    delete source;
 
     fclose(inFile); // release file descriptor memory
+    if (default_conf.timeline != stdout) {
+        fclose(default_conf.timeline);
+    }
 
     print_statistics(&stats);
 
@@ -0,0 +1,308 @@
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.hpp"
+
+static const uint8_t NO_REG = 0xff;
+
+/* Function to read instruction from the input trace. Populates the inst struct
+ *
+ * returns true if an instruction was read successfully. Returns false at end of trace
+ *
+ */
+bool text_source_t::read_instruction(inst_t* inst)
+{
+    int ret;
+
+    if (inst == NULL) {
+        fprintf(stderr, "Fetch requires a valid pointer to populate\n");
+        return false;
+    }
+
+    // Don't modify this line. Instruction fetch might break otherwise!
+    ret = fscanf(inFile, "%" PRIx64 " %d %d %d %d %" PRIx64 " %" PRIx64 " %d\n", &inst->inst_addr, &inst->opcode, &inst->dest_reg,
+                    &inst->src_reg[0], &inst->src_reg[1], &inst->ld_st_addr, &inst->br_target, (int *) &inst->br_taken);
+
+    if (ret != 8) { // Check if something went really wrong
+        if (!feof(inFile)) { // Check if end of file has been reached
+            fprintf(stderr, "Something went wrong and we could not parse the instruction\n");
+        }
+        return false;
+    }
+
+    return true;
+}
+
+static uint64_t zigzag(uint64_t delta) {
+    return (delta << 1) ^ uint64_t(int64_t(delta) >> 63);
+}
+
+static uint64_t unzigzag(uint64_t z) {
+    return (z >> 1) ^ (0 - (z & 1));
+}
+
+static uint8_t* put_varint(uint8_t* p, uint64_t x) {
+    while (x >= 0x80) {
+        *p++ = uint8_t(x) | 0x80;
+        x >>= 7;
+    }
+    *p++ = uint8_t(x);
+    return p;
+}
+
+static bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t* x) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) {
+            return false;
+        }
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            *x = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int32_t get_reg(uint8_t b) {
+    return b == NO_REG ? -1 : int32_t(b);
+}
+
+binary_source_t::binary_source_t(const uint8_t* data, size_t len, uint64_t count, void* map, size_t map_len)
+    : p(data), end(data + len), left(count), inst_addr(0), ld_st_addr(0), br_target(0), map(map), map_len(map_len)
+{
+}
+
+binary_source_t::~binary_source_t()
+{
+    if (map_len != 0) {
+        munmap(map, map_len);
+    } else {
+        free(map);
+    }
+}
+
+bool binary_source_t::read_instruction(inst_t* inst)
+{
+    if (left == 0) {
+        return false;
+    }
+
+    uint64_t d[3];
+    bool ok = end - p >= 4;
+    const uint8_t* rec = p;
+    p += ok ? 4 : 0;
+    for (int i = 0; ok && i < 3; i++) {
+        ok = get_varint(p, end, &d[i]);
+    }
+    if (!ok) {
+        fprintf(stderr, "The binary trace ends in the middle of an instruction\n");
+        left = 0;
+        return false;
+    }
+
+    inst->opcode = rec[0] & 0x7f;
+    inst->br_taken = (rec[0] & 0x80) != 0;
+    inst->dest_reg = get_reg(rec[1]);
+    inst->src_reg[0] = get_reg(rec[2]);
+    inst->src_reg[1] = get_reg(rec[3]);
+    inst->inst_addr = inst_addr += unzigzag(d[0]);
+    inst->ld_st_addr = ld_st_addr += unzigzag(d[1]);
+    inst->br_target = br_target += unzigzag(d[2]);
+
+    left--;
+    return true;
+}
+
+// Waits a moment for the other side of the ring; yields at first and then
+// sleeps, so a side that waits long doesn't hold a core
+static void ring_wait(unsigned* spins) {
+    if (++*spins < 64) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+async_source_t::async_source_t(inst_source_t* source)
+    : source(source), ring(new batch_t[BATCHES]), produced(0), consumed(0), stop(false), next(0), done(false)
+{
+    producer = std::thread(&async_source_t::produce, this);
+}
+
+async_source_t::~async_source_t()
+{
+    stop = true;
+    producer.join();
+    delete[] ring;
+    delete source;
+}
+
+void async_source_t::produce()
+{
+    for (uint64_t seq = 0;; seq++) {
+        unsigned spins = 0;
+        while (seq - consumed.load(std::memory_order_acquire) == BATCHES) {
+            if (stop) {
+                return;
+            }
+            ring_wait(&spins);
+        }
+
+        batch_t& b = ring[seq % BATCHES];
+        b.count = 0;
+        while (b.count < BATCH && source->read_instruction(&b.inst[b.count])) {
+            b.count++;
+        }
+        b.last = b.count < BATCH;
+        produced.store(seq + 1, std::memory_order_release);
+        if (b.last) {
+            return;
+        }
+    }
+}
+
+bool async_source_t::read_instruction(inst_t* inst)
+{
+    while (!done) {
+        uint64_t seq = consumed.load(std::memory_order_relaxed);
+        unsigned spins = 0;
+        while (produced.load(std::memory_order_acquire) == seq) {
+            ring_wait(&spins);
+        }
+
+        batch_t& b = ring[seq % BATCHES];
+        if (next < b.count) {
+            *inst = b.inst[next++];
+            return true;
+        }
+        if (b.last) {
+            done = true;
+        } else {
+            next = 0;
+            consumed.store(seq + 1, std::memory_order_release);
+        }
+    }
+    return false;
+}
+
+// Opens the trace in, binary or text. A binary trace is mapped when it is a
+// regular file and read into memory otherwise. Returns NULL, having said
+// why, if the trace can't be used.
+inst_source_t* trace_open(FILE* in)
+{
+    int first = getc(in);
+    if (first != TRACE_MAGIC[0]) {
+        ungetc(first, in);
+        return new text_source_t(in);
+    }
+    ungetc(first, in);
+
+    uint8_t* data = NULL;
+    size_t len = 0;
+    void* map = NULL;
+    size_t map_len = 0;
+
+    struct stat st;
+    if (fstat(fileno(in), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        map_len = size_t(st.st_size);
+        map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+        if (map == MAP_FAILED) {
+            map = NULL;
+            map_len = 0;
+        } else {
+            madvise(map, map_len, MADV_SEQUENTIAL);
+            data = (uint8_t*) map;
+            len = map_len;
+        }
+    }
+    if (map == NULL) {
+        size_t cap = 1 << 20;
+        data = (uint8_t*) malloc(cap);
+        size_t got;
+        while ((got = fread(data + len, 1, cap - len, in)) > 0) {
+            len += got;
+            if (len == cap) {
+                cap *= 2;
+                data = (uint8_t*) realloc(data, cap);
+            }
+        }
+        map = data;
+    }
+
+    uint32_t version = 0;
+    uint64_t count = 0;
+    if (len >= TRACE_HEADER && memcmp(data, TRACE_MAGIC, 8) == 0) {
+        memcpy(&version, data + 8, 4);
+        memcpy(&count, data + 16, 8);
+    }
+    if (version != TRACE_VERSION) {
+        fprintf(stderr, version == 0 ? "Not a trace\n" : "Unsupported binary trace version %u\n", version);
+        if (map_len != 0) {
+            munmap(map, map_len);
+        } else {
+            free(map);
+        }
+        return NULL;
+    }
+    return new binary_source_t(data + TRACE_HEADER, len - TRACE_HEADER, count, map, map_len);
+}
+
+/**
+ * Converts the text trace in to the binary format, written to out, which has
+ * to be seekable for the record count to be filled in at the end
+ */
+bool trace_convert(FILE* in, FILE* out)
+{
+    uint8_t header[TRACE_HEADER] = {0};
+    uint32_t version = TRACE_VERSION;
+    memcpy(header, TRACE_MAGIC, 8);
+    memcpy(header + 8, &version, 4);
+    fwrite(header, 1, TRACE_HEADER, out);
+
+    text_source_t source(in);
+    inst_t inst;
+    uint64_t count = 0;
+    uint64_t prev[3] = {0, 0, 0};
+    uint8_t rec[4 + 3 * 10];
+    while (source.read_instruction(&inst)) {
+        count++;
+        int32_t regs[3] = {inst.dest_reg, inst.src_reg[0], inst.src_reg[1]};
+        if (inst.opcode < 0 || inst.opcode > 0x7f) {
+            fprintf(stderr, "Instruction %" PRIu64 ": opcode %d doesn't fit the binary format\n", count, inst.opcode);
+            return false;
+        }
+        rec[0] = uint8_t(inst.opcode) | (inst.br_taken ? 0x80 : 0);
+        for (int i = 0; i < 3; i++) {
+            if (regs[i] < -1 || regs[i] >= NO_REG) {
+                fprintf(stderr, "Instruction %" PRIu64 ": register %d doesn't fit the binary format\n", count, regs[i]);
+                return false;
+            }
+            rec[1 + i] = regs[i] == -1 ? NO_REG : uint8_t(regs[i]);
+        }
+
+        uint64_t fields[3] = {inst.inst_addr, inst.ld_st_addr, inst.br_target};
+        uint8_t* p = rec + 4;
+        for (int i = 0; i < 3; i++) {
+            p = put_varint(p, zigzag(fields[i] - prev[i]));
+            prev[i] = fields[i];
+        }
+        fwrite(rec, 1, size_t(p - rec), out);
+    }
+    if (!feof(in)) {
+        return false;
+    }
+
+    if (fseek(out, 16, SEEK_SET) != 0 || fwrite(&count, 8, 1, out) != 1 || fflush(out) != 0) {
+        fprintf(stderr, "Failed to write the binary trace\n");
+        return false;
+    }
+    return true;
+}
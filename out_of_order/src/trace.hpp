@@ -0,0 +1,108 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "procsim.hpp"
+
+// Binary trace: a header, then one record per instruction.
+//
+// Header: TRACE_MAGIC, then the version and a zero word as 32-bit words and
+// the number of records as a 64-bit word, all little-endian.
+//
+// Record: the opcode byte (taken bit in bit 7), the dest, src1 and src2
+// register bytes (0xff for -1), then inst_addr, ld_st_addr and br_target,
+// each as the zigzag LEB128 varint of its difference from the same field of
+// the previous record (from 0 in the first one).
+#define TRACE_MAGIC "PSIMTR\0\0"
+#define TRACE_VERSION 1
+#define TRACE_HEADER 24
+
+// Reads a text trace, one "addr opcode dest src1 src2 ldst brtarget taken"
+// line per instruction
+class text_source_t : public inst_source_t {
+public:
+    explicit text_source_t(FILE* in) : inFile(in) {}
+    bool read_instruction(inst_t* p_inst);
+
+private:
+    FILE* inFile;
+};
+
+// Decodes a binary trace held in memory, mapped or read in
+class binary_source_t : public inst_source_t {
+public:
+    binary_source_t(const uint8_t* data, size_t len, uint64_t count, void* map, size_t map_len);
+    ~binary_source_t();
+    bool read_instruction(inst_t* p_inst);
+
+private:
+    const uint8_t* p;
+    const uint8_t* end;
+    uint64_t left;          // records not decoded yet
+    uint64_t inst_addr, ld_st_addr, br_target;
+    void* map;              // what to unmap, or free if map_len is 0
+    size_t map_len;
+};
+
+// Replays a trace already in memory. The trace is only read, so any number
+// of sources can share it.
+class memory_source_t : public inst_source_t {
+public:
+    explicit memory_source_t(const std::vector<inst_t>* trace) : trace(trace), next(0) {}
+
+    bool read_instruction(inst_t* p_inst)
+    {
+        if (next == trace->size()) {
+            return false;
+        }
+        *p_inst = (*trace)[next++];
+        return true;
+    }
+
+private:
+    const std::vector<inst_t>* trace;
+    size_t next;
+};
+
+// Decodes another source on a producer thread, a batch at a time, into a
+// ring that read_instruction empties in order. There is one producer and
+// one consumer, so the ring needs no lock, only the two counters. It owns
+// the source it wraps.
+class async_source_t : public inst_source_t {
+public:
+    explicit async_source_t(inst_source_t* source);
+    ~async_source_t();
+    bool read_instruction(inst_t* p_inst);
+
+private:
+    static const size_t BATCH = 4096;
+    static const size_t BATCHES = 8;
+
+    struct batch_t {
+        inst_t inst[BATCH];
+        size_t count;
+        bool last;          // the source ended in this batch
+    };
+
+    void produce();
+
+    inst_source_t* source;
+    batch_t* ring;
+    std::atomic<uint64_t> produced;
+    std::atomic<uint64_t> consumed;
+    std::atomic<bool> stop;
+    size_t next;            // in the batch being consumed
+    bool done;
+    std::thread producer;
+};
+
+inst_source_t* trace_open(FILE* in);
+bool trace_convert(FILE* in, FILE* out);
+
+#endif // TRACE_HPP